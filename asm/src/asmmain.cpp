@@ -5,15 +5,24 @@
 
 int main(int argc, char** argv) {
     using namespace detvm;
-    if (argc < 2) {
-        std::cerr << "Usage: detasm <input.detasm> [output.dto]\n";
+    // --compress writes the object as an lz container
+    bool compress = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--compress") compress = true;
+        else paths.push_back(arg);
+    }
+
+    if (paths.empty()) {
+        std::cerr << "Usage: detasm [--compress] <input.detasm> [output.dto]\n";
         return 1;
     }
 
-    std::string input_path = argv[1];
+    std::string input_path = paths[0];
     std::string output_path;
 
-    if (argc >= 3) output_path = argv[2];
+    if (paths.size() >= 2) output_path = paths[1];
     else
         output_path = std::filesystem::path(input_path).replace_extension(".dto").string();
 
@@ -34,7 +43,7 @@ int main(int argc, char** argv) {
 
         auto result = assembler::assembleFirstPass(lines); // your assembler pipeline
 
-       Writer::writeObject(output_path, result);
+       Writer::writeObject(output_path, result, compress);
         std::cout << " Assembled " << input_path << " -> " << output_path << "\n";
         
     } catch (const std::exception& e) {
@@ -112,6 +112,10 @@ AssemblerResult assembleFirstPass(const std::vector<std::string>& lines) {
                 result.unresolved.push_back({result.code.size()-1, getOperandToken(line,1), inst.opcode, 1});
                 break;
             case detvm::Opcode::CALL:
+            case detvm::Opcode::SPAWN:
+            case detvm::Opcode::PARMAP:
+            case detvm::Opcode::PARREDUCE:
+            case detvm::Opcode::CALLN:
                 result.unresolved.push_back({result.code.size()-1, getOperandToken(line,0), inst.opcode, 0});
                 break;
             default: break;
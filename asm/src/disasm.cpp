@@ -4,88 +4,14 @@
 #include <string>
 #include <cstdint>
 #include <iomanip>
+#include <map>
 #include "detvm.hpp" // includes Opcode, Instruction, ConstType, etc.
 #include "constant_pool.hpp"
+#include "dvm_format.hpp"
+#include "lz.hpp"
 
 using namespace detvm;
 
-static std::string opcodeName(detvm::Opcode op) {
-    using namespace detvm;
-    switch (op) {
-        case Opcode::LOADC:    return "LOADC";
-        case Opcode::LOADL:    return "LOADL";
-        case Opcode::STOREL:   return "STOREL";
-        case Opcode::MOV:      return "MOV";
-        case Opcode::ADD:      return "ADD";
-        case Opcode::SUB:      return "SUB";
-        case Opcode::MUL:      return "MUL";
-        case Opcode::DIV:      return "DIV";
-        case Opcode::NEG:      return "NEG";
-        case Opcode::CMP:      return "CMP";
-        case Opcode::NOT:      return "NOT";
-        case Opcode::AND:      return "AND";
-        case Opcode::OR:       return "OR";
-
-        case Opcode::JMP:      return "JMP";
-        case Opcode::JZ:       return "JZ";
-        case Opcode::JNZ:      return "JNZ";
-        case Opcode::JL:       return "JL";
-        case Opcode::JG:       return "JG";
-        case Opcode::JLZ:      return "JLZ";
-        case Opcode::JLNZ:     return "JLNZ";
-        case Opcode::JLL:      return "JLL";
-        case Opcode::JLG:      return "JLG";
-
-        case Opcode::CALL:     return "CALL";
-        case Opcode::RET:      return "RET";
-        case Opcode::ENTER:    return "ENTER";
-        case Opcode::LEAVE:    return "LEAVE";
-        case Opcode::ADDL:     return "ADDL";
-        case Opcode::SUBL:     return "SUBL";
-        case Opcode::MULL:     return "MULL";
-        case Opcode::DIVL:     return "DIVL";
-        case Opcode::CMPL:     return "CMPL";
-        case Opcode::NEGL:     return "NEGL";
-        case Opcode::NOTL:     return "NOTL";
-        case Opcode::ANDL:     return "ANDL";
-        case Opcode::ORL:      return "ORL";
-        case Opcode::MOVL:     return "MOVL";
-        case Opcode::LOADCL:   return "LOADCL";
-        case Opcode::LOADARG:  return "LOADARG";
-
-        case Opcode::NEWARR:   return "NEWARR";
-        case Opcode::LOADARR:  return "LOADARR";
-        case Opcode::STOREARR: return "STOREARR";
-        case Opcode::LEN:      return "LEN";
-        case Opcode::FREE:     return "FREE";
-
-        case Opcode::TAG:      return "TAG";
-        case Opcode::WHEN:     return "WHEN";
-        case Opcode::TYPEOF:   return "TYPEOF";
-
-        case Opcode::NOP:      return "NOP";
-        case Opcode::PRINT:    return "PRINT";
-        case Opcode::HALT:     return "HALT";
-        case Opcode::LOADP:    return "LOADP";
-        case Opcode::LOADLP:   return "LOADLP";
-
-        case Opcode::OWN:      return "OWN";
-        case Opcode::MOVE:     return "MOVE";
-        case Opcode::VIEW:     return "VIEW";
-        case Opcode::EDIT:     return "EDIT";
-        case Opcode::CLONE:    return "CLONE";
-        case Opcode::DROP:     return "DROP";
-
-        case Opcode::INCREF:    return "INCREF";
-        case Opcode::DECREF:    return "DECREF";
-        case Opcode::CHECKEXCL: return "CHECKEXCL";
-        case Opcode::CHECKLIVE: return "CHECKLIVE";
-        case Opcode::RAIIDROP:  return "RAIIDROP";
-
-        default: return "UNKNOWN";
-    }
-}
-
 static std::string constName(ConstType t) {
     switch (t) {
         case ConstType::INT: return "INT";
@@ -103,7 +29,7 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    std::ifstream in(argv[1], std::ios::binary);
+    lz::InputFile in(argv[1]); // unpacked as it is read when compressed
     if (!in) {
         std::cerr << "cannot open file: " << argv[1] << "\n";
         return 1;
@@ -122,14 +48,56 @@ int main(int argc, char** argv) {
     };
 
     try {
+        if (in.compressed())
+            std::cout << "Container: DTLZ (" << in.packedSize() << " bytes, " << in.unpackedSize() << " unpacked)\n";
+
         // === HEADER ===
         expect("DTVM", 4);
         uint64_t version;
         read_u64(version);
         std::cout << "Header: DTVM (version " << version << ")\n";
 
+        // === SECTION DIRECTORY (version 3 on) ===
+        std::vector<dvm::Section> sections;
+        if (version >= 3) {
+            expect("SDIR", 4);
+            uint32_t count;
+            read_u32(count);
+            sections.resize(count);
+            for (auto& sec : sections) in.read(reinterpret_cast<char*>(&sec), sizeof(sec));
+            if (!in) throw std::runtime_error("truncated section directory");
+
+            // checked before anything is sized from the directory, as the loader does
+            const uint64_t file_size = in.compressed() ? in.unpackedSize() : static_cast<uint64_t>(in.packedSize());
+            for (const auto& sec : sections)
+                if (sec.offset > file_size || sec.size > file_size - sec.offset)
+                    throw std::runtime_error("section " + std::string(sec.tag, 4) + " runs past the end of the file");
+
+            std::cout << "\n[Sections] (" << count << " entries)\n";
+            for (const auto& sec : sections) {
+                std::vector<char> bytes(sec.size);
+                in.seekg(static_cast<std::streamoff>(sec.offset));
+                in.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+                bool ok = in && dvm::checksum(bytes.data(), bytes.size()) == sec.checksum;
+                in.clear();
+                std::cout << "  " << std::string(sec.tag, 4) << "  offset=" << sec.offset << "  size=" << sec.size
+                          << "  checksum=0x" << std::hex << std::setw(8) << std::setfill('0') << sec.checksum
+                          << std::dec << std::setfill(' ') << (ok ? "  ok" : "  BAD") << "\n";
+            }
+        }
+        // positions `in` at a section; false when the image has none by that name
+        auto seek = [&](const char* tag) {
+            for (const auto& sec : sections) {
+                if (std::string(sec.tag, 4) != tag) continue;
+                in.seekg(static_cast<std::streamoff>(sec.offset));
+                return true;
+            }
+            return false;
+        };
+
         // === POOL ===
-        expect("POOL", 4);
+        if (version < 3) expect("POOL", 4);
+        else if (!seek("POOL")) throw std::runtime_error("no POOL section");
         size_t pool_size;
         in.read(reinterpret_cast<char*>(&pool_size), sizeof(pool_size));
         std::cout << "\n[Constant Pool] (" << pool_size << " entries)\n";
@@ -178,25 +146,146 @@ int main(int argc, char** argv) {
         }
 
         // === CODE ===
-        expect("TEXT", 4);
-        size_t text_size;
-        in.read(reinterpret_cast<char*>(&text_size), sizeof(text_size));
+        size_t text_size = 0;
+        if (version >= 3) {
+            if (!seek("TEXT")) throw std::runtime_error("no TEXT section");
+            for (const auto& sec : sections)
+                if (std::string(sec.tag, 4) == "TEXT") text_size = sec.size / sizeof(Instruction);
+        } else {
+            expect("TEXT", 4);
+            in.read(reinterpret_cast<char*>(&text_size), sizeof(text_size));
+        }
+        if (version == 2) in.seekg((Program::TEXT_ALIGN - in.tellg() % Program::TEXT_ALIGN) % Program::TEXT_ALIGN,
+                                   std::ios::cur);
+
+        std::vector<Instruction> text(text_size);
+        for (auto& inst : text) {
+            in.read(reinterpret_cast<char*>(&inst.opcode), sizeof(inst.opcode));
+            in.read(reinterpret_cast<char*>(&inst.a), sizeof(inst.a));
+            in.read(reinterpret_cast<char*>(&inst.b), sizeof(inst.b));
+            in.read(reinterpret_cast<char*>(&inst.c), sizeof(inst.c));
+        }
+
+        auto read_name = [&]() {
+            uint32_t len;
+            read_u32(len);
+            std::string s(len, '\0');
+            in.read(s.data(), len);
+            return s;
+        };
+
+        // === FUNCTION INDEX (version 3 on) ===
+        std::vector<dvm::FunctionEntry> functions;
+        if (seek("FIDX")) {
+            uint32_t count;
+            read_u32(count);
+            std::cout << "\n[Function Index] (" << count << " entries)\n";
+            for (uint32_t i = 0; i < count; ++i) {
+                dvm::FunctionEntry fn;
+                in.read(reinterpret_cast<char*>(&fn), sizeof(fn));
+                functions.push_back(fn);
+                bool ok = fn.pc_start <= fn.pc_end && fn.pc_end <= text.size() &&
+                          dvm::checksum(text.data() + fn.pc_start, (fn.pc_end - fn.pc_start) * sizeof(Instruction)) ==
+                              fn.checksum;
+                std::cout << "  pc " << fn.pc_start << ".." << fn.pc_end << "  checksum=0x" << std::hex
+                          << std::setw(8) << std::setfill('0') << fn.checksum << std::dec << std::setfill(' ')
+                          << (ok ? "  ok" : "  BAD") << "\n";
+            }
+        }
+
+        // === ENTRY CODE (optional): TEXT outside the function index ===
+        if (seek("ENTR")) {
+            uint32_t sum;
+            read_u32(sum);
+            bool ok = std::all_of(functions.begin(), functions.end(), [&](const dvm::FunctionEntry& fn) {
+                          return fn.pc_end <= text.size();
+                      }) && dvm::entryChecksum(text.data(), text.size(), functions) == sum;
+            std::cout << "\n[Entry Code] checksum=0x" << std::hex << std::setw(8) << std::setfill('0') << sum
+                      << std::dec << std::setfill(' ') << (ok ? "  ok" : "  BAD") << "\n";
+        }
+
+        // === NATIVE IMPORTS (optional) ===
+        // Before version 3 the sections follow TEXT in order, each behind its tag.
+        std::string tag(4, '\0');
+        auto next_tag = [&] {
+            tag.assign(4, '\0');
+            if (in.peek() != std::char_traits<char>::eof()) in.read(tag.data(), 4);
+        };
+        if (version < 3) next_tag();
+
+        std::vector<std::string> natives;
+        if (version >= 3 ? seek("NATV") : tag == "NATV") {
+            uint32_t native_count;
+            read_u32(native_count);
+            for (uint32_t i = 0; i < native_count; ++i) natives.push_back(read_name());
+
+            std::cout << "\n[Native Imports] (" << natives.size() << " entries)\n";
+            for (size_t i = 0; i < natives.size(); ++i)
+                std::cout << "  [" << i << "] " << natives[i] << "\n";
+            if (version < 3) next_tag();
+        }
+
+        // === SYMBOLS (optional) ===
+        std::vector<FunctionSymbol> funcs;
+        std::multimap<uint32_t, std::string> labels;
+        bool has_syms;
+        if (version >= 3) {
+            has_syms = seek("SYMS");
+        } else {
+            has_syms = tag != std::string(4, '\0');
+            if (has_syms && tag != "SYMS") throw std::runtime_error("expected tag SYMS");
+            size_t sect_size;
+            if (has_syms) in.read(reinterpret_cast<char*>(&sect_size), sizeof(sect_size));
+        }
+        if (has_syms) {
+            uint32_t func_count;
+            read_u32(func_count);
+            for (uint32_t i = 0; i < func_count; ++i) {
+                FunctionSymbol fn;
+                fn.name = read_name();
+                read_u32(fn.pc_start);
+                read_u32(fn.pc_end);
+                read_u16(fn.params);
+                read_u16(fn.locals);
+                funcs.push_back(std::move(fn));
+            }
+
+            uint32_t label_count;
+            read_u32(label_count);
+            for (uint32_t i = 0; i < label_count; ++i) {
+                std::string name = read_name();
+                uint32_t pc;
+                read_u32(pc);
+                labels.emplace(pc, std::move(name));
+            }
+        }
 
         std::cout << "\n[Text Section] (" << text_size << " instructions)\n";
+        size_t next_func = 0;
         for (size_t i = 0; i < text_size; ++i) {
-            Opcode op;
-            uint16_t a, b, c;
-            in.read(reinterpret_cast<char*>(&op), sizeof(op));
-            in.read(reinterpret_cast<char*>(&a), sizeof(a));
-            in.read(reinterpret_cast<char*>(&b), sizeof(b));
-            in.read(reinterpret_cast<char*>(&c), sizeof(c));
+            for (; next_func < funcs.size() && funcs[next_func].pc_start <= i; ++next_func) {
+                const auto& fn = funcs[next_func];
+                std::cout << "\n<" << fn.name << ">  pc " << fn.pc_start << ".." << fn.pc_end
+                          << "  params=" << fn.params << "  locals=" << fn.locals << "\n";
+            }
+
+            auto [lo, hi] = labels.equal_range(static_cast<uint32_t>(i));
+            for (auto it = lo; it != hi; ++it) {
+                // function entries are already printed as headers
+                bool is_func = false;
+                for (const auto& fn : funcs) is_func |= (fn.name == it->second && fn.pc_start == i);
+                if (!is_func) std::cout << "      ." << it->second << ":\n";
+            }
 
+            const Instruction& inst = text[i];
             std::cout << std::setw(4) << i << ": "
-                      << opcodeName(op)
-                      << "  a=" << a << "  b=" << b << "  c=" << c << "\n";
+                      << opcodeName(inst.opcode)
+                      << "  a=" << inst.a << "  b=" << inst.b << "  c=" << inst.c;
+            if (inst.opcode == Opcode::CALLN && inst.a < natives.size()) std::cout << "  ; " << natives[inst.a];
+            std::cout << "\n";
         }
 
-        if (!in.eof()) {
+        if (version < 3 && !in.eof()) {
             std::streampos pos = in.tellg();
             in.seekg(0, std::ios::end);
             auto end = in.tellg();
@@ -63,7 +63,16 @@ detvm::Opcode mnemonicToOpcode(const std::string& mnemonic) {
     {"JLZ", detvm::Opcode::JLZ},          {"JLNZ", detvm::Opcode::JLNZ},      {"JLL", detvm::Opcode::JLL}, 
     {"JLG", detvm::Opcode::JLG},          {"LOADP", detvm::Opcode::LOADP},    {"LOADLP", detvm::Opcode::LOADLP},
     {"CALL",     detvm::Opcode::CALL},    {"RET",     detvm::Opcode::RET},    {"PRINT",   detvm::Opcode::PRINT},
-    {"RAIIDROP", detvm::Opcode::RAIIDROP},{"HALT",    detvm::Opcode::HALT},   {"LOADARG", detvm::Opcode::LOADARG}
+    {"RAIIDROP", detvm::Opcode::RAIIDROP},{"HALT",    detvm::Opcode::HALT},   {"LOADARG", detvm::Opcode::LOADARG},
+    {"OWN",      detvm::Opcode::OWN},     {"MOVE",    detvm::Opcode::MOVE},   {"VIEW",    detvm::Opcode::VIEW},
+    {"EDIT",     detvm::Opcode::EDIT},    {"DROP",    detvm::Opcode::DROP},   {"NOP",     detvm::Opcode::NOP},
+    {"CHECKPOINT", detvm::Opcode::CHECKPOINT},
+    {"SPAWN",    detvm::Opcode::SPAWN},   {"YIELD",   detvm::Opcode::YIELD},  {"JOIN",    detvm::Opcode::JOIN},
+    {"CHNEW",    detvm::Opcode::CHNEW},   {"CHSEND",  detvm::Opcode::CHSEND}, {"CHRECV",  detvm::Opcode::CHRECV},
+    {"CHTRY",    detvm::Opcode::CHTRY},   {"SHNEW",   detvm::Opcode::SHNEW},  {"ALOAD",   detvm::Opcode::ALOAD},
+    {"ASTORE",   detvm::Opcode::ASTORE},  {"AFETCHADD", detvm::Opcode::AFETCHADD}, {"ACAS", detvm::Opcode::ACAS},
+    {"FENCE",    detvm::Opcode::FENCE},   {"PARMAP",  detvm::Opcode::PARMAP}, {"PARREDUCE", detvm::Opcode::PARREDUCE},
+    {"CALLN",    detvm::Opcode::CALLN},   {"FREAD",   detvm::Opcode::FREAD},  {"FWRITE",  detvm::Opcode::FWRITE}
 };
 
     auto it = table.find(mnemonic);
@@ -170,6 +179,26 @@ switch(op) {
         inst.c = 0;
         break;
 
+    case detvm::Opcode::MOV:
+        inst.a = parseReg(dst, regtype);
+        if (regtype != 'r') throw std::runtime_error("MOV destination must be global");
+        inst.b = parseReg(tokens[0], regtype);
+        if (regtype != 'r') throw std::runtime_error("MOV source must be global");
+        inst.c = 0;
+        break;
+
+    // Ownership: dest <- src, both global
+    case detvm::Opcode::OWN:
+    case detvm::Opcode::MOVE:
+    case detvm::Opcode::VIEW:
+    case detvm::Opcode::EDIT:
+        inst.a = parseReg(dst, regtype);
+        if (regtype != 'r') throw std::runtime_error("Ownership destination must be global (%rN)");
+        inst.b = parseReg(tokens[0], regtype);
+        if (regtype != 'r') throw std::runtime_error("Ownership source must be global (%rN)");
+        inst.c = 0;
+        break;
+
     case detvm::Opcode::AND:
     case detvm::Opcode::OR:
         inst.a = parseReg(dst, regtype);
@@ -232,15 +261,86 @@ switch(op) {
     case detvm::Opcode::PRINT:
     case detvm::Opcode::RET:
     case detvm::Opcode::RAIIDROP:
+    case detvm::Opcode::DROP:
         inst.a = dst.empty() ? parseReg(tokens[0], regtype) : parseReg(dst, regtype);
         break;
 
     case detvm::Opcode::CALL:
+    case detvm::Opcode::SPAWN:
+    case detvm::Opcode::PARMAP:
+    case detvm::Opcode::PARREDUCE:
         inst.a = 0xFF; // patched by linker
         inst.b = 0;    // argc placeholder
         inst.c = 0;    // locals placeholder
         break;
 
+    case detvm::Opcode::CALLN:
+        // the arity comes from the native, the result always goes to %r0
+        if (tokens.size() != 1 || !dst.empty())
+            throw std::runtime_error("CALLN takes only the native's name: arguments come from %p, the result goes to %r0");
+        inst.a = 0xFF; // patched by linker
+        inst.b = 0;    // argc placeholder
+        inst.c = 0;    // locals placeholder
+        break;
+
+    case detvm::Opcode::JOIN:
+        inst.a = parseReg(tokens[0], regtype);
+        if (regtype != 'r') throw std::runtime_error("JOIN operand must be global (%rN)");
+        break;
+
+    case detvm::Opcode::CHNEW:
+    case detvm::Opcode::SHNEW:
+        inst.a = parseReg(dst, regtype);
+        if (regtype != 'r') throw std::runtime_error(mnemonic + " destination must be global (%rN)");
+        inst.c = std::stoi(tokens[0]);
+        break;
+
+    case detvm::Opcode::CHSEND:
+    case detvm::Opcode::CHRECV:
+    case detvm::Opcode::CHTRY: {
+        char bType, cType = 'r';
+        inst.a = parseReg(dst, regtype);
+        inst.b = parseReg(tokens[0], bType);
+        if (op == detvm::Opcode::CHTRY) {
+            if (tokens.size() != 2) throw std::runtime_error("CHTRY needs a channel and an ok register");
+            inst.c = parseReg(tokens[1], cType);
+        }
+        if (regtype != 'r' || bType != 'r' || cType != 'r')
+            throw std::runtime_error("Channel operands must be global (%rN)");
+        break;
+    }
+
+    // all of them: "<op> %rB, %rC -> %rA"
+    case detvm::Opcode::ALOAD:
+    case detvm::Opcode::ASTORE:
+    case detvm::Opcode::AFETCHADD:
+    case detvm::Opcode::ACAS: {
+        if (tokens.size() != 2) throw std::runtime_error(mnemonic + " needs two operands and a destination");
+        char bType, cType;
+        inst.a = parseReg(dst, regtype);
+        inst.b = parseReg(tokens[0], bType);
+        inst.c = parseReg(tokens[1], cType);
+        if (regtype != 'r' || bType != 'r' || cType != 'r')
+            throw std::runtime_error(mnemonic + " operands must be global (%rN)");
+        break;
+    }
+
+    // "FREAD %rPath -> %rA", "FWRITE %rPath, %rData -> %rA"
+    case detvm::Opcode::FREAD:
+    case detvm::Opcode::FWRITE: {
+        const size_t want = op == detvm::Opcode::FREAD ? 1 : 2;
+        if (tokens.size() != want || dst.empty())
+            throw std::runtime_error(mnemonic + (want == 1 ? " needs a path and a destination"
+                                                           : " needs a path, the data and a destination"));
+        char bType, cType = 'r';
+        inst.a = parseReg(dst, regtype);
+        inst.b = parseReg(tokens[0], bType);
+        if (want == 2) inst.c = parseReg(tokens[1], cType);
+        if (regtype != 'r' || bType != 'r' || cType != 'r')
+            throw std::runtime_error(mnemonic + " operands must be global (%rN)");
+        break;
+    }
+
     case detvm::Opcode::JMP:
         inst.a = 0xFF;
         inst.b = inst.c = 0;
@@ -7,33 +7,44 @@
 int main(int argc, char** argv) {
 
     using namespace detvm;
-    if (argc < 3) {
-        std::cerr << "Usage: detld <input1.dto> [input2.dto ...] <output.dtb>\n";
+    // --strip leaves out the optional SYMS section, --compress writes an lz container
+    bool strip = false;
+    bool compress = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--strip") strip = true;
+        else if (arg == "--compress") compress = true;
+        else paths.push_back(arg);
+    }
+
+    if (paths.size() < 2) {
+        std::cerr << "Usage: detld [--strip] [--compress] <input1.dto> [input2.dto ...] <output.dtb>\n";
         return 1;
     }
 
     try {
         std::vector<assembler::AssemblerResult> objects;
 
-        // all args except the last are inputs
-        for (int i = 1; i < argc - 1; ++i) {
-            std::string path = argv[i];
-            auto object = linker::readObject(path);
+        // all paths except the last are inputs
+        for (size_t i = 0; i + 1 < paths.size(); ++i) {
+            auto object = linker::readObject(paths[i]);
             objects.push_back(object);   
         }
 
-        std::string output_path = argv[argc - 1];
+        std::string output_path = paths.back();
 
         auto linked = linker::linkObjects(objects);
         linker::linkLabels(
         linked.code,
         linked.label_to_pc,
         linked.unresolved,
-        linked.funcs
+        linked.funcs,
+        &linked.natives
         );
-        Writer::writeProgramBinary(output_path, linked);
+        Writer::writeProgramBinary(output_path, linked, !strip, compress);
 
-        std::cout << "Linked " << (argc - 2) << " objects -> " << output_path << "\n";
+        std::cout << "Linked " << objects.size() << " objects -> " << output_path << "\n";
     } catch (const std::exception& e) {
         std::cerr << "Linking failed: " << e.what() << "\n";
         return 1;
@@ -1,4 +1,5 @@
 #include "linker.hpp"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 
@@ -8,9 +9,18 @@ void linkLabels(
     std::vector<detvm::Instruction>& code,
     const std::unordered_map<std::string, size_t>& label_to_pc,
     const std::vector<detvm::assembler::UnresolvedJump>& unresolved,
-    const std::unordered_map<std::string, assembler::Function>& funcs)
+    const std::unordered_map<std::string, assembler::Function>& funcs,
+    std::vector<std::string>* natives)
 {
     for (const auto& u : unresolved) {
+        if (u.op == detvm::Opcode::CALLN) {
+            if (!natives) throw std::runtime_error("CALLN " + u.label + ": no native import table");
+            auto it = std::find(natives->begin(), natives->end(), u.label);
+            if (it == natives->end()) it = natives->insert(natives->end(), u.label);
+            code[u.inst_index].a = static_cast<uint16_t>(it - natives->begin());
+            continue;
+        }
+
         auto it_label = label_to_pc.find(u.label);
         auto it_func  = funcs.find(u.label);
 
@@ -41,7 +51,12 @@ void linkLabels(
                 inst.b = static_cast<uint16_t>(target_pc);
                 break;
 
-            case detvm::Opcode::CALL: {
+            case detvm::Opcode::CALL:
+            case detvm::Opcode::SPAWN:
+            case detvm::Opcode::PARMAP:
+            case detvm::Opcode::PARREDUCE: {
+                if (it_func == funcs.end())
+                    throw std::runtime_error(std::string(detvm::opcodeName(u.op)) + " target is not a function: " + u.label);
                 // automatic argc and local count
                 const auto& f = it_func->second;
                 inst.a = static_cast<uint16_t>(target_pc);
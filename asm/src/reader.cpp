@@ -1,5 +1,6 @@
 #include "helpers.hpp"
 #include "linker.hpp"
+#include "lz.hpp"
 #include <fstream>
 #include <vector>
 #include <cstdint>
@@ -11,7 +12,7 @@ namespace detvm
     
 
 assembler::AssemblerResult linker::readObject(const std::string& path) {
-    std::ifstream in(path, std::ios::binary);
+    lz::InputFile in(path); // unpacked as it is read when compressed
     if (!in) throw std::runtime_error("Failed to open object file: " + path);
 
     assembler::AssemblerResult result;
@@ -43,6 +44,7 @@ assembler::AssemblerResult linker::readObject(const std::string& path) {
                 result.pool.addInt(val);
                 break;
             }
+            case ConstType::FLOAT:
             case ConstType::DOUBLE: {
                 double val;
                 in.read(reinterpret_cast<char*>(&val), sizeof(val));
@@ -64,7 +66,7 @@ assembler::AssemblerResult linker::readObject(const std::string& path) {
                 break;
             }
             default:
-                throw std::runtime_error("Unknown constant pool type: " + type);
+                throw std::runtime_error("Unknown constant pool type: " + std::to_string(type));
         }
     }
 
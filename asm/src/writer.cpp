@@ -2,12 +2,29 @@
 #include "assemble.hpp"
 #include "linker.hpp"
 #include "writer.hpp"
+#include "dvm_format.hpp"
+#include "lz.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
 namespace detvm::Writer
 {
-    
-void writeObject(const std::string& path, const assembler::AssemblerResult& result) {
+
+// the finished file, packed into an lz container when asked to
+static void save(const std::string& path, const std::string& bytes, bool compress) {
     std::ofstream out(path, std::ios::binary);
     if (!out) throw std::runtime_error("Failed to open output file: " + path);
+    if (compress) {
+        auto packed = lz::compress(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+        out.write(reinterpret_cast<const char*>(packed.data()), static_cast<std::streamsize>(packed.size()));
+    } else {
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+    if (!out) throw std::runtime_error("Failed to write " + path);
+}
+    
+void writeObject(const std::string& path, const assembler::AssemblerResult& result, bool compress) {
+    std::ostringstream out;
 
     // === HEADER ===
     const uint32_t MAGIC = 0x44544F42; // "DTOB"
@@ -30,6 +47,7 @@ void writeObject(const std::string& path, const assembler::AssemblerResult& resu
                 out.write(reinterpret_cast<const char*>(&val), sizeof(val));
                 break;
             }
+            case ConstType::FLOAT: // held as a double, like the loaders read it
             case ConstType::DOUBLE: {
                 double val = std::get<double>(entry.value);
                 out.write(reinterpret_cast<const char*>(&val), sizeof(val));
@@ -46,6 +64,8 @@ void writeObject(const std::string& path, const assembler::AssemblerResult& resu
                 out.write(&val, sizeof(val));
                 break;
             }
+            default:
+                throw std::runtime_error("cannot write constant of type " + std::to_string(type));
         }
     }
 
@@ -115,73 +135,172 @@ void writeObject(const std::string& path, const assembler::AssemblerResult& resu
         out.write(reinterpret_cast<const char*>(&inst), sizeof(Instruction));
     }
 
-    out.close();
+    save(path, out.str(), compress);
 }
 
 
-void writeProgramBinary(const std::string& path, const assembler::AssemblerResult& result) {
-    std::ofstream out(path, std::ios::binary);
-    if (!out) throw std::runtime_error("Failed to open output file: " + path);
+namespace {
 
-    // === HEADER ===
-    out.write("DTVM", 4);
-    uint64_t version = 1;
-    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+// one section's bytes, built in memory so the directory can be written first
+struct Buf {
+    std::vector<uint8_t> bytes;
 
-    // === CONSTANT POOL ===
-    out.write("POOL", 4);
-    size_t pool_size = result.pool.entries.size();
-    out.write(reinterpret_cast<const char*>(&pool_size), sizeof(pool_size));
+    template <typename T>
+    void put(const T& v) {
+        const auto* p = reinterpret_cast<const uint8_t*>(&v);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+    void raw(const void* data, size_t n) {
+        const auto* p = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), p, p + n);
+    }
+    void name(const std::string& s) {
+        put(static_cast<uint32_t>(s.size()));
+        raw(s.data(), s.size());
+    }
+};
+
+} // namespace
 
+void writeProgramBinary(const std::string& path, const assembler::AssemblerResult& result, bool with_symbols,
+                        bool compress) {
+    std::vector<std::pair<const char*, Buf>> sections;
+
+    // === CONSTANT POOL, plus where each constant starts ===
+    Buf pool, cidx;
+    pool.put(static_cast<size_t>(result.pool.entries.size()));
     for (auto& entry : result.pool.entries) {
-        uint8_t type = static_cast<uint8_t>(entry.type);
-        out.write(reinterpret_cast<const char*>(&type), 1);
+        cidx.put(static_cast<uint64_t>(pool.bytes.size()));
+        pool.put(static_cast<uint8_t>(entry.type));
 
         switch (entry.type) {
             case ConstType::INT: {
                 int32_t val = std::get<int32_t>(entry.value);
-                size_t sz = sizeof(val);
-                out.write(reinterpret_cast<const char*>(&sz), sizeof(sz));
-                out.write(reinterpret_cast<const char*>(&val), sizeof(val));
+                pool.put(sizeof(val));
+                pool.put(val);
                 break;
             }
+            case ConstType::FLOAT: // held as a double, like the loaders read it
             case ConstType::DOUBLE: {
                 double val = std::get<double>(entry.value);
-                size_t sz = sizeof(val);
-                out.write(reinterpret_cast<const char*>(&sz), sizeof(sz));
-                out.write(reinterpret_cast<const char*>(&val), sizeof(val));
+                pool.put(sizeof(val));
+                pool.put(val);
                 break;
             }
             case ConstType::STRING: {
                 const std::string& s = std::get<std::string>(entry.value);
-                size_t sz = s.size();
-                out.write(reinterpret_cast<const char*>(&sz), sizeof(sz));
-                out.write(s.data(), sz);
+                pool.put(s.size());
+                pool.raw(s.data(), s.size());
                 break;
             }
             case ConstType::CHAR: {
                 char val = std::get<char>(entry.value);
-                size_t sz = sizeof(val);
-                out.write(reinterpret_cast<const char*>(&sz), sizeof(sz));
-                out.write(reinterpret_cast<const char*>(&val), sizeof(val));
+                pool.put(sizeof(val));
+                pool.put(val);
                 break;
             }
+            default:
+                throw std::runtime_error("cannot write constant of type " +
+                                         std::to_string(static_cast<int>(entry.type)));
         }
     }
+    sections.emplace_back("POOL", std::move(pool));
+    sections.emplace_back("CIDX", std::move(cidx));
+
+    // === CODE SECTION, in the VM's own layout so Program::map() runs it in place ===
+    Buf text;
+    text.raw(result.code.data(), result.code.size() * sizeof(detvm::Instruction));
+    sections.emplace_back("TEXT", std::move(text));
+
+    // === FUNCTION INDEX: boundaries and a checksum per function, for lazy loading ===
+    std::vector<const assembler::Function*> funcs;
+    for (const auto& [name, fn] : result.funcs) funcs.push_back(&fn);
+    std::sort(funcs.begin(), funcs.end(), [](const auto* a, const auto* b) {
+        return a->pc_start != b->pc_start ? a->pc_start < b->pc_start : a->name < b->name;
+    });
+
+    Buf fidx;
+    std::vector<dvm::FunctionEntry> entries;
+    fidx.put(static_cast<uint32_t>(funcs.size()));
+    for (const auto* fn : funcs) {
+        dvm::FunctionEntry e{};
+        e.pc_start = static_cast<uint32_t>(fn->pc_start);
+        e.pc_end = static_cast<uint32_t>(std::max(fn->pc_end, fn->pc_start));
+        e.checksum = dvm::checksum(result.code.data() + e.pc_start, (e.pc_end - e.pc_start) * sizeof(detvm::Instruction));
+        fidx.put(e);
+        entries.push_back(e);
+    }
+    sections.emplace_back("FIDX", std::move(fidx));
+
+    // === ENTRY CODE: the rest of TEXT, checked at load since it runs first ===
+    Buf entr;
+    entr.put(dvm::entryChecksum(result.code.data(), result.code.size(), entries));
+    sections.emplace_back("ENTR", std::move(entr));
+
+    // === NATIVE IMPORTS (only when CALLN is used) ===
+    if (!result.natives.empty()) {
+        Buf natv;
+        natv.put(static_cast<uint32_t>(result.natives.size()));
+        for (const auto& name : result.natives) natv.name(name);
+        sections.emplace_back("NATV", std::move(natv));
+    }
 
-    // === CODE SECTION ===
-    out.write("TEXT", 4);
-    size_t code_count = result.code.size();
-    out.write(reinterpret_cast<const char*>(&code_count), sizeof(code_count));
+    // === SYMBOLS (optional) ===
+    if (with_symbols) {
+        std::vector<std::pair<std::string, size_t>> labels(result.label_to_pc.begin(), result.label_to_pc.end());
+        std::sort(labels.begin(), labels.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second < b.second : a.first < b.first;
+        });
+
+        Buf syms;
+        syms.put(static_cast<uint32_t>(funcs.size()));
+        for (const auto* fn : funcs) {
+            syms.name(fn->name);
+            syms.put(static_cast<uint32_t>(fn->pc_start));
+            syms.put(static_cast<uint32_t>(std::max(fn->pc_end, fn->pc_start)));
+            syms.put(fn->params);
+            syms.put(fn->locals);
+        }
+        syms.put(static_cast<uint32_t>(labels.size()));
+        for (const auto& [label, pc] : labels) {
+            syms.name(label);
+            syms.put(static_cast<uint32_t>(pc));
+        }
+        sections.emplace_back("SYMS", std::move(syms));
+    }
 
-    for (auto& inst : result.code) {
-        out.write(reinterpret_cast<const char*>(&inst.opcode), sizeof(inst.opcode));
-        out.write(reinterpret_cast<const char*>(&inst.a), 2);
-        out.write(reinterpret_cast<const char*>(&inst.b), 2);
-        out.write(reinterpret_cast<const char*>(&inst.c), 2);
+    // === HEADER + SECTION DIRECTORY ===
+    Buf head;
+    head.raw("DTVM", 4);
+    head.put(static_cast<uint64_t>(detvm::Program::CURRENT_VERSION));
+    head.raw("SDIR", 4);
+    head.put(static_cast<uint32_t>(sections.size()));
+
+    uint64_t offset = head.bytes.size() + sections.size() * sizeof(dvm::Section);
+    std::vector<uint64_t> pads;
+    for (const auto& [tag, buf] : sections) {
+        uint64_t pad = 0;
+        if (std::string(tag) == "TEXT")
+            pad = (detvm::Program::TEXT_ALIGN - offset % detvm::Program::TEXT_ALIGN) % detvm::Program::TEXT_ALIGN;
+        pads.push_back(pad);
+        offset += pad;
+
+        dvm::Section s{};
+        std::memcpy(s.tag, tag, 4);
+        s.checksum = dvm::checksum(buf.bytes.data(), buf.bytes.size());
+        s.offset = offset;
+        s.size = buf.bytes.size();
+        head.put(s);
+        offset += buf.bytes.size();
     }
 
-    out.close();
+    std::string file(head.bytes.begin(), head.bytes.end());
+    for (size_t k = 0; k < sections.size(); ++k) {
+        file.append(pads[k], '\0');
+        const auto& bytes = sections[k].second.bytes;
+        file.append(bytes.begin(), bytes.end());
+    }
+    save(path, file, compress);
 }
 
 
@@ -0,0 +1,265 @@
+// detvm-bench: assembles, links and runs every bench/workloads/*.detasm
+// repeatedly, then reports median / p99 time per run and per VM instruction.
+// Results can be saved as JSON and compared against a saved baseline.
+
+#include "assemble.hpp"
+#include "linker.hpp"
+#include "writer.hpp"
+#include "detvm.hpp"
+#include "observed_run.hpp"
+#include "bench_util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace fs = std::filesystem;
+using namespace detvm;
+using namespace detvm::bench;
+
+namespace {
+
+struct InstrCounter {
+    uint64_t count = 0;
+    void before(VM&, size_t, const Instruction&) { ++count; }
+    void after(VM&, size_t, const Instruction&) {}
+};
+
+struct Result {
+    std::string name;
+    uint64_t instrs = 0;
+    size_t reps = 0;
+    double median_run_ns = 0;
+    double p99_run_ns = 0;
+    double median_instr_ns = 0;
+    double p99_instr_ns = 0;
+};
+
+struct Options {
+    fs::path dir = DETVM_BENCH_DIR;
+    size_t reps = 25;
+    size_t warmup = 3;
+    std::string filter;
+    std::string json_out;
+    std::string baseline;
+    double threshold = 5.0; // percent
+    bool fail_on_regression = false;
+};
+
+// === assemble + link a single-file workload into an executable image ===
+std::vector<uint8_t> buildProgram(const fs::path& source, std::vector<std::string>& expects) {
+    std::ifstream in(source);
+    if (!in) throw std::runtime_error("cannot open " + source.string());
+
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        if (line.rfind("; expect:", 0) == 0) expects.push_back(assembler::trim(line.substr(9)));
+        lines.push_back(line);
+    }
+
+    auto object = assembler::assembleFirstPass(lines);
+    auto linked = linker::linkObjects({object});
+    linker::linkLabels(linked.code, linked.label_to_pc, linked.unresolved, linked.funcs, &linked.natives);
+
+    fs::path tmp = fs::temp_directory_path() / ("detvm-bench-" + source.stem().string() + ".dvm");
+    Writer::writeProgramBinary(tmp.string(), linked);
+    auto image = assembler::readFile(tmp.string());
+    fs::remove(tmp);
+    return image;
+}
+
+Result runWorkload(const std::string& name, const std::vector<uint8_t>& image,
+                   const std::vector<std::string>& expects, const Options& opt) {
+    Result r;
+    r.name = name;
+
+    // one counted run, which also checks the workload still computes the right thing
+    {
+        std::ostringstream captured;
+        auto* old = std::cout.rdbuf(captured.rdbuf());
+        VM vm;
+        vm.loadProgram(image);
+        InstrCounter counter;
+        vm.runObserved(counter);
+        std::cout.rdbuf(old);
+
+        r.instrs = counter.count;
+        std::string out = captured.str();
+        for (const auto& e : expects) {
+            if (out.find(e) == std::string::npos)
+                throw std::runtime_error(name + ": expected output \"" + e + "\" missing");
+        }
+    }
+
+    std::vector<double> times;
+    times.reserve(opt.reps);
+    {
+        MuteCout mute;
+        for (size_t i = 0; i < opt.warmup + opt.reps; ++i) {
+            VM vm;
+            vm.loadProgram(image);
+            auto t0 = std::chrono::steady_clock::now();
+            vm.run();
+            auto t1 = std::chrono::steady_clock::now();
+            if (i >= opt.warmup)
+                times.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+        }
+    }
+
+    double per = r.instrs ? static_cast<double>(r.instrs) : 1.0;
+    r.reps = times.size();
+    r.median_run_ns = percentile(times, 0.5);
+    r.p99_run_ns = percentile(times, 0.99);
+    r.median_instr_ns = r.median_run_ns / per;
+    r.p99_instr_ns = r.p99_run_ns / per;
+    return r;
+}
+
+void writeJson(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("cannot write " + path);
+    // one workload per line keeps the file diffable and trivially parseable
+    out << "{\n  \"workloads\": [\n" << std::setprecision(6);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"instructions\": " << r.instrs
+            << ", \"reps\": " << r.reps
+            << ", \"median_ns_per_run\": " << r.median_run_ns
+            << ", \"p99_ns_per_run\": " << r.p99_run_ns
+            << ", \"median_ns_per_instr\": " << r.median_instr_ns
+            << ", \"p99_ns_per_instr\": " << r.p99_instr_ns << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// reads back the median ns/instruction of each workload from writeJson() output
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot open baseline " + path);
+
+    auto field = [](const std::string& line, const std::string& key) -> std::string {
+        size_t k = line.find("\"" + key + "\":");
+        if (k == std::string::npos) return "";
+        size_t start = line.find_first_not_of(" \"", k + key.size() + 3);
+        size_t end = line.find_first_of(",}\"", start);
+        return line.substr(start, end - start);
+    };
+
+    std::map<std::string, double> base;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string name = field(line, "name");
+        std::string med = field(line, "median_ns_per_instr");
+        if (!name.empty() && !med.empty()) base[name] = std::stod(med);
+    }
+    return base;
+}
+
+void usage() {
+    std::cerr << "Usage: detvm-bench [options] [workload-dir]\n"
+              << "  --reps <n>              timed runs per workload (default 25)\n"
+              << "  --warmup <n>            untimed runs first (default 3)\n"
+              << "  --filter <substr>       only workloads whose name contains substr\n"
+              << "  --json <file>           save results as JSON\n"
+              << "  --baseline <file>       compare against a saved JSON result\n"
+              << "  --threshold <pct>       regression threshold for --baseline (default 5)\n"
+              << "  --fail-on-regression    exit 1 when a workload regresses past the threshold\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error(arg + " needs a value");
+            return argv[++i];
+        };
+        try {
+            if (arg == "--reps") opt.reps = std::max<size_t>(1, std::stoul(next()));
+            else if (arg == "--warmup") opt.warmup = std::stoul(next());
+            else if (arg == "--filter") opt.filter = next();
+            else if (arg == "--json") opt.json_out = next();
+            else if (arg == "--baseline") opt.baseline = next();
+            else if (arg == "--threshold") opt.threshold = std::stod(next());
+            else if (arg == "--fail-on-regression") opt.fail_on_regression = true;
+            else if (arg == "-h" || arg == "--help") { usage(); return 0; }
+            else if (!arg.empty() && arg[0] == '-') { usage(); return 1; }
+            else opt.dir = arg;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<fs::path> sources;
+    for (const auto& entry : fs::directory_iterator(opt.dir)) {
+        if (entry.path().extension() != ".detasm") continue;
+        if (!opt.filter.empty() && entry.path().stem().string().find(opt.filter) == std::string::npos) continue;
+        sources.push_back(entry.path());
+    }
+    std::sort(sources.begin(), sources.end());
+    if (sources.empty()) {
+        std::cerr << "no workloads found in " << opt.dir << "\n";
+        return 1;
+    }
+
+    std::vector<Result> results;
+    try {
+        for (const auto& src : sources) {
+            std::vector<std::string> expects;
+            std::vector<uint8_t> image;
+            {
+                MuteCout mute; // linker chatter
+                image = buildProgram(src, expects);
+            }
+            results.push_back(runWorkload(src.stem().string(), image, expects, opt));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "bench failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    std::map<std::string, double> base;
+    if (!opt.baseline.empty()) base = readBaseline(opt.baseline);
+
+    bool regressed = false;
+    std::cout << std::left << std::setw(14) << "workload" << std::right
+              << std::setw(12) << "instrs"
+              << std::setw(14) << "med us/run" << std::setw(14) << "p99 us/run"
+              << std::setw(14) << "med ns/ins" << std::setw(14) << "p99 ns/ins";
+    if (!base.empty()) std::cout << std::setw(12) << "vs base";
+    std::cout << "\n" << std::fixed;
+
+    for (const auto& r : results) {
+        std::cout << std::left << std::setw(14) << r.name << std::right
+                  << std::setw(12) << r.instrs << std::setprecision(1)
+                  << std::setw(14) << r.median_run_ns / 1e3 << std::setw(14) << r.p99_run_ns / 1e3
+                  << std::setprecision(2)
+                  << std::setw(14) << r.median_instr_ns << std::setw(14) << r.p99_instr_ns;
+        if (auto it = base.find(r.name); it != base.end() && it->second > 0) {
+            double delta = 100.0 * (r.median_instr_ns - it->second) / it->second;
+            bool bad = delta > opt.threshold;
+            regressed |= bad;
+            std::cout << std::setw(10) << std::showpos << delta << std::noshowpos << "%"
+                      << (bad ? "  REGRESSION" : "");
+        }
+        std::cout << "\n";
+    }
+
+    if (!opt.json_out.empty()) {
+        writeJson(opt.json_out, results);
+        std::cout << "results written to " << opt.json_out << "\n";
+    }
+
+    return (regressed && opt.fail_on_regression) ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <streambuf>
+#include <vector>
+
+namespace detvm::bench {
+
+// Swallows everything written to it; used to mute PRINT and tool chatter
+// while timing.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Redirects std::cout to a NullBuffer for the lifetime of the guard.
+class MuteCout {
+public:
+    MuteCout() : old_(std::cout.rdbuf(&null_)) {}
+    ~MuteCout() { std::cout.rdbuf(old_); }
+    MuteCout(const MuteCout&) = delete;
+    MuteCout& operator=(const MuteCout&) = delete;
+
+private:
+    NullBuffer null_;
+    std::streambuf* old_;
+};
+
+// Nearest-rank percentile, q in [0, 1].
+inline double percentile(std::vector<double> v, double q) {
+    std::sort(v.begin(), v.end());
+    size_t idx = static_cast<size_t>(std::ceil(q * v.size()));
+    return v[std::min(v.size() - 1, idx ? idx - 1 : 0)];
+}
+
+} // namespace detvm::bench
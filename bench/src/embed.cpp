@@ -0,0 +1,127 @@
+// detvm-embed: the embedding API in action. Loads a linked program once,
+// then calls one function over and over with the same integer arguments and
+// reports the result and the call rate. With --threads every thread runs its
+// own VM over the one shared Program.
+//
+// --fork instead runs the program up to its CHECKPOINT once, then serves each
+// "request" from a forked clone of that warmed-up VM (ForkPool) resumed
+// after the checkpoint.
+
+#include "runtime.hpp"
+#include "fork_pool.hpp"
+#include "bench_util.hpp"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace detvm;
+
+static int forkRequests(const std::string& path, size_t requests) {
+    VM parent;
+    parent.stop_at_checkpoint = true;
+    parent.loadProgram(assembler::readFile(path));
+    {
+        bench::MuteCout mute; // setup chatter
+        parent.run();
+    }
+    if (!parent.checkpointed) throw std::runtime_error("program has no CHECKPOINT");
+
+    ForkPool pool(parent, 64);
+    bench::NullBuffer null_buf;
+    std::ostream null_out(&null_buf);
+    std::ostringstream last;
+
+    double fork_ns = 0, run_ns = 0;
+    for (size_t i = 0; i < requests; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        auto vm = pool.acquire();
+        auto t1 = std::chrono::steady_clock::now();
+        vm->out = (i + 1 == requests) ? static_cast<std::ostream*>(&last) : &null_out;
+        vm->resume();
+        auto t2 = std::chrono::steady_clock::now();
+        fork_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+        run_ns += std::chrono::duration<double, std::nano>(t2 - t1).count();
+        if (pool.available() == 0) pool.refill();
+    }
+
+    std::cout << last.str();
+    if (requests)
+        std::cerr << requests << " requests: " << fork_ns / requests / 1e3 << " us acquire, "
+                  << run_ns / requests / 1e3 << " us resume (per request)\n";
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::string path, name;
+    std::vector<Value> args;
+    size_t calls = 1000000;
+    size_t threads = 1;
+    bool fork = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        try {
+            if (arg == "--calls" && i + 1 < argc) calls = std::stoul(argv[++i]);
+            else if (arg == "--fork") fork = true;
+            else if (arg == "--threads" && i + 1 < argc) threads = std::max<size_t>(1, std::stoul(argv[++i]));
+            else if (path.empty()) path = arg;
+            else if (name.empty()) name = arg;
+            else args.push_back(Value(static_cast<int32_t>(std::stol(arg))));
+        } catch (const std::exception& e) {
+            std::cerr << arg << ": " << e.what() << "\n";
+            return 1;
+        }
+    }
+    if (fork && !path.empty()) {
+        try {
+            return forkRequests(path, calls);
+        } catch (const std::exception& e) {
+            std::cerr << "embed failed: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    if (name.empty()) {
+        std::cerr << "Usage: detvm-embed [--calls <n>] [--threads <n>] <program.dvm> <function> [int args...]\n"
+                  << "       detvm-embed --fork [--calls <n>] <program.dvm>\n";
+        return 1;
+    }
+
+    try {
+        auto program = Program::load(assembler::readFile(path), true);
+
+        std::vector<Runtime> runtimes;
+        runtimes.reserve(threads);
+        for (size_t t = 0; t < threads; ++t) runtimes.emplace_back(program);
+        const FunctionSymbol& fn = runtimes[0].function(name);
+
+        std::vector<Value> results(threads);
+        auto worker = [&](size_t t) {
+            Runtime& rt = runtimes[t];
+            for (size_t i = 0; i < calls; ++i) results[t] = rt.call(fn, args);
+        };
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; ++t) pool.emplace_back(worker, t);
+        worker(0);
+        for (auto& th : pool) th.join();
+        auto t1 = std::chrono::steady_clock::now();
+
+        for (const auto& r : results) {
+            if (r.str() != results[0].str())
+                throw std::runtime_error("threads disagree: " + r.str() + " vs " + results[0].str());
+        }
+
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        size_t total = calls * threads;
+        std::cout << name << " = " << results[0].str() << "\n";
+        if (secs > 0)
+            std::cerr << total << " calls on " << threads << " thread(s) in " << secs * 1e3 << " ms ("
+                      << static_cast<size_t>(total / secs) << " calls/s)\n";
+    } catch (const std::exception& e) {
+        std::cerr << "embed failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
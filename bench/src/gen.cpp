@@ -0,0 +1,53 @@
+// detvm-gen: writes a synthetic detasm program of configurable size.
+
+#include "synth.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char** argv) {
+    using namespace detvm::bench;
+
+    SynthParams p;
+    std::filesystem::path out_dir;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> size_t {
+            if (i + 1 >= argc) throw std::runtime_error(arg + " needs a value");
+            return std::stoul(argv[++i]);
+        };
+        try {
+            if (arg == "--functions") p.functions = next();
+            else if (arg == "--labels") p.labels = next();
+            else if (arg == "--constants") p.constants = next();
+            else if (arg == "--files") p.files = next();
+            else out_dir = arg;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    if (out_dir.empty()) {
+        std::cerr << "Usage: detvm-gen [--functions N] [--labels M] [--constants K] [--files F] <out-dir>\n";
+        return 1;
+    }
+
+    try {
+        auto files = generateProgram(p);
+        std::filesystem::create_directories(out_dir);
+        for (size_t f = 0; f < files.size(); ++f) {
+            auto path = out_dir / ("gen_" + std::to_string(f) + ".detasm");
+            std::ofstream out(path);
+            if (!out) throw std::runtime_error("cannot write " + path.string());
+            for (const auto& line : files[f]) out << line << "\n";
+        }
+        std::cout << "Generated " << p.functions << " functions in " << files.size()
+                  << " files -> " << out_dir.string() << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "generation failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "synth.hpp"
+#include <stdexcept>
+
+namespace detvm::bench {
+
+static std::string funcName(size_t g) { return "f" + std::to_string(g); }
+
+std::vector<std::vector<std::string>> generateProgram(const SynthParams& p) {
+    if (p.files == 0 || p.functions == 0)
+        throw std::runtime_error("synth: need at least one file and one function");
+
+    // 3 setup + 3 per label + 3 call/return per function, plus main and the stub
+    size_t estimate = p.functions * (6 + 3 * p.labels) + 8;
+    if (estimate > 0xFFFF)
+        throw std::runtime_error("synth: ~" + std::to_string(estimate) +
+                                 " instructions exceeds the 16-bit pc range");
+
+    const size_t k = p.constants ? p.constants : 1;
+    std::vector<std::vector<std::string>> files(p.files);
+
+    auto& entry = files[0];
+    entry.push_back("CALL main");
+    entry.push_back("HALT");
+    entry.push_back(".func main");
+    entry.push_back(".params 0");
+    entry.push_back(".locals 1");
+    entry.push_back("var result");
+    entry.push_back("    LOADC 1 -> %r1");
+    entry.push_back("    LOADP %r1 -> %p0");
+    entry.push_back("    CALL " + funcName(0));
+    entry.push_back("    PRINT %r0");
+    entry.push_back("    RET result");
+    entry.push_back(".end");
+
+    for (size_t g = 0; g < p.functions; ++g) {
+        auto& out = files[g % p.files];
+        std::string name = funcName(g);
+
+        out.push_back(".func " + name);
+        out.push_back(".params 1");
+        out.push_back("param seed");
+        out.push_back(".locals 3");
+        out.push_back("var acc");
+        out.push_back("var konst");
+        out.push_back("var flag");
+        out.push_back("    LOADARG seed -> acc");
+        out.push_back("    LOADCL " + std::to_string(g % k) + " -> konst");
+        out.push_back("    LOADCL 0 -> flag");
+
+        for (size_t m = 0; m < p.labels; ++m) {
+            std::string label = name + "_L" + std::to_string(m);
+            std::string next = name + "_L" + std::to_string(m + 1);
+            out.push_back(".label " + label);
+            out.push_back("    LOADCL " + std::to_string((g * p.labels + m) % k) + " -> konst");
+            out.push_back("    ADDL acc, konst -> acc");
+            out.push_back("    JLNZ flag, " + next); // never taken, still needs resolving
+        }
+        out.push_back(".label " + name + "_L" + std::to_string(p.labels));
+
+        if (g + 1 < p.functions) {
+            out.push_back("    LOADLP acc -> %p0");
+            out.push_back("    CALL " + funcName(g + 1));
+            out.push_back("    STOREL %r0 -> acc");
+        }
+        out.push_back("    RET acc");
+        out.push_back(".end");
+    }
+
+    return files;
+}
+
+} // namespace detvm::bench
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace detvm::bench {
+
+// Shape of a generated detasm program.
+struct SynthParams {
+    size_t functions = 100;  // N functions in total
+    size_t labels = 4;       // M labels per function
+    size_t constants = 100;  // K distinct integer constants
+    size_t files = 1;        // spread round-robin across this many object files
+};
+
+// One detasm source (as lines) per object file. Function g calls g+1, which
+// lives in the next file, so linking has cross-file calls to resolve; file 0
+// also holds the entry stub and main. Throws when the program would not fit
+// the 16-bit pc operands.
+std::vector<std::vector<std::string>> generateProgram(const SynthParams& p);
+
+} // namespace detvm::bench
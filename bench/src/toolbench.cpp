@@ -0,0 +1,187 @@
+// detvm-toolbench: times each toolchain stage (assemble, read objects, link,
+// resolve labels, write the executable, load it into a VM) on synthetic
+// programs of growing size, to show how every stage scales.
+
+#include "assemble.hpp"
+#include "linker.hpp"
+#include "writer.hpp"
+#include "detvm.hpp"
+#include "bench_util.hpp"
+#include "synth.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace fs = std::filesystem;
+using namespace detvm;
+using namespace detvm::bench;
+
+namespace {
+
+enum Stage { ASSEMBLE, READ_OBJECT, LINK_OBJECTS, LINK_LABELS, WRITE_BINARY, LOAD_PROGRAM, STAGE_COUNT };
+
+const char* stageName(size_t s) {
+    static const char* names[] = {"assemble", "readObject", "linkObjects", "linkLabels",
+                                  "writeBinary", "loadProgram"};
+    return names[s];
+}
+
+struct Result {
+    SynthParams params;
+    size_t instrs = 0;
+    double median_ms[STAGE_COUNT] = {};
+};
+
+template <typename F>
+double timeMs(F&& f) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+Result measure(const SynthParams& p, size_t reps, const fs::path& work) {
+    auto sources = generateProgram(p);
+    std::vector<double> samples[STAGE_COUNT];
+    Result r;
+    r.params = p;
+
+    MuteCout mute; // linker chatter
+    for (size_t rep = 0; rep < reps; ++rep) {
+        // === assembleFirstPass over every file ===
+        std::vector<assembler::AssemblerResult> objects(sources.size());
+        samples[ASSEMBLE].push_back(timeMs([&] {
+            for (size_t f = 0; f < sources.size(); ++f)
+                objects[f] = assembler::assembleFirstPass(sources[f]);
+        }));
+
+        std::vector<std::string> paths;
+        for (size_t f = 0; f < objects.size(); ++f) {
+            paths.push_back((work / ("gen_" + std::to_string(f) + ".dto")).string());
+            Writer::writeObject(paths.back(), objects[f]);
+        }
+
+        // === readObject ===
+        std::vector<assembler::AssemblerResult> loaded(paths.size());
+        samples[READ_OBJECT].push_back(timeMs([&] {
+            for (size_t f = 0; f < paths.size(); ++f) loaded[f] = linker::readObject(paths[f]);
+        }));
+
+        // === linkObjects / linkLabels ===
+        assembler::AssemblerResult linked;
+        samples[LINK_OBJECTS].push_back(timeMs([&] { linked = linker::linkObjects(loaded); }));
+        samples[LINK_LABELS].push_back(timeMs([&] {
+            linker::linkLabels(linked.code, linked.label_to_pc, linked.unresolved, linked.funcs, &linked.natives);
+        }));
+        r.instrs = linked.code.size();
+
+        // === writeProgramBinary ===
+        std::string exe = (work / "gen.dvm").string();
+        samples[WRITE_BINARY].push_back(timeMs([&] { Writer::writeProgramBinary(exe, linked); }));
+
+        // === loadProgram (mapped, TEXT used in place) ===
+        samples[LOAD_PROGRAM].push_back(timeMs([&] {
+            VM vm;
+            vm.loadProgram(exe);
+        }));
+    }
+
+    for (size_t s = 0; s < STAGE_COUNT; ++s) r.median_ms[s] = percentile(samples[s], 0.5);
+    return r;
+}
+
+void usage() {
+    std::cerr << "Usage: detvm-toolbench [options]\n"
+              << "  --functions N --labels M --constants K --files F\n"
+              << "                  measure one program shape instead of the default sweep\n"
+              << "  --reps <n>      runs per shape, median reported (default 3)\n"
+              << "  --json <file>   save results as JSON\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    SynthParams single;
+    bool custom = false;
+    size_t reps = 3;
+    std::string json_out;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error(arg + " needs a value");
+            return argv[++i];
+        };
+        try {
+            if (arg == "--functions") { single.functions = std::stoul(next()); custom = true; }
+            else if (arg == "--labels") { single.labels = std::stoul(next()); custom = true; }
+            else if (arg == "--constants") { single.constants = std::stoul(next()); custom = true; }
+            else if (arg == "--files") { single.files = std::stoul(next()); custom = true; }
+            else if (arg == "--reps") reps = std::max<size_t>(1, std::stoul(next()));
+            else if (arg == "--json") json_out = next();
+            else { usage(); return arg == "-h" || arg == "--help" ? 0 : 1; }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    // default sweep: grow the program, then spread a fixed program over more files
+    std::vector<SynthParams> shapes;
+    if (custom) {
+        shapes.push_back(single);
+    } else {
+        for (size_t n : {250, 500, 1000, 2000}) shapes.push_back({n, 4, n, 1});
+        for (size_t f : {16, 256, 1000}) shapes.push_back({2000, 4, 2000, f});
+    }
+
+    fs::path work = fs::temp_directory_path() /
+        ("detvm-toolbench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    fs::create_directories(work);
+
+    std::vector<Result> results;
+    try {
+        for (const auto& p : shapes) results.push_back(measure(p, reps, work));
+    } catch (const std::exception& e) {
+        fs::remove_all(work);
+        std::cerr << "toolbench failed: " << e.what() << "\n";
+        return 1;
+    }
+    fs::remove_all(work);
+
+    std::cout << std::setw(6) << "funcs" << std::setw(7) << "labels" << std::setw(7) << "consts"
+              << std::setw(7) << "files" << std::setw(9) << "instrs";
+    for (size_t s = 0; s < STAGE_COUNT; ++s) std::cout << std::setw(13) << stageName(s);
+    std::cout << "   (median ms)\n" << std::fixed << std::setprecision(3);
+
+    for (const auto& r : results) {
+        std::cout << std::setw(6) << r.params.functions << std::setw(7) << r.params.labels
+                  << std::setw(7) << r.params.constants << std::setw(7) << r.params.files
+                  << std::setw(9) << r.instrs;
+        for (size_t s = 0; s < STAGE_COUNT; ++s) std::cout << std::setw(13) << r.median_ms[s];
+        std::cout << "\n";
+    }
+
+    if (!json_out.empty()) {
+        std::ofstream out(json_out);
+        if (!out) {
+            std::cerr << "cannot write " << json_out << "\n";
+            return 1;
+        }
+        out << "{\n  \"shapes\": [\n" << std::setprecision(6);
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            out << "    {\"functions\": " << r.params.functions << ", \"labels\": " << r.params.labels
+                << ", \"constants\": " << r.params.constants << ", \"files\": " << r.params.files
+                << ", \"instructions\": " << r.instrs;
+            for (size_t s = 0; s < STAGE_COUNT; ++s)
+                out << ", \"" << stageName(s) << "_ms\": " << r.median_ms[s];
+            out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        std::cout << "results written to " << json_out << "\n";
+    }
+    return 0;
+}
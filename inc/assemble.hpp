@@ -36,7 +36,7 @@ struct AssemblerResult {
     std::vector<UnresolvedJump> unresolved;
     std::unordered_map<std::string, size_t> label_to_pc;
     std::unordered_map<std::string, Function> funcs;
-    
+    std::vector<std::string> natives; // CALLN imports, filled in by linkLabels
 };
 
 
@@ -0,0 +1,47 @@
+#pragma once
+#include "detvm.hpp"
+#include "slot_table.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace detvm {
+
+// Bounded multi-producer / multi-consumer queue of Values (Vyukov's ring:
+// one sequence number per cell, no locks). Values are moved in and out, so
+// an array sent down a channel changes hands without being copied.
+class Channel {
+public:
+    explicit Channel(size_t capacity); // rounded up to a power of two
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Moves v in and leaves it empty; false (v untouched) when full.
+    bool push(Value& v);
+    // Moves the oldest value into out; false (out untouched) when empty.
+    bool pop(Value& out);
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        Value value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0}; // next push
+    alignas(64) std::atomic<size_t> tail_{0}; // next pop
+};
+
+// Channels visible to a group of VMs, by id. Ids come from CHNEW (or the
+// host) and can be passed around like any int.
+class ChannelTable : public SlotTable<Channel> {
+public:
+    ChannelTable() : SlotTable("channel") {}
+    int32_t create(size_t capacity);
+};
+
+} // namespace detvm
@@ -1,19 +1,53 @@
 #pragma once
 #include <vector>
 #include <array>
+#include <atomic>
 #include <variant>
 #include <string>
 #include <memory>
 #include <stack>
 #include <unordered_map>
 #include <iostream>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
 #include "ops.hpp"
 #include "reader.hpp"
 
 namespace detvm {
 
+struct Value;
+class MappedFile;
+
+// Read-only typed array over a memory-mapped file (the map_i32, map_f64 and
+// map_bytes natives). Elements are decoded on access, so nothing is copied
+// and the kernel pages the file in as it is touched. Little-endian int32,
+// IEEE double, or one unsigned byte per element.
+struct MappedArray {
+    enum class Kind : uint8_t { Int32, Double, Bytes };
+
+    std::shared_ptr<const MappedFile> file;
+    const uint8_t* base = nullptr;
+    size_t count = 0;
+    Kind kind = Kind::Bytes;
+
+    // Throws when the size of the file is not a whole number of elements.
+    static std::shared_ptr<const MappedArray> open(const std::string& path, Kind kind);
+
+    Value at(size_t i) const;                // throws std::out_of_range
+    std::vector<Value> materialize() const;  // every element, as a plain array
+};
+
 struct Value {
-    std::variant<int32_t, double, bool, std::string, std::vector<Value>, std::monostate> data;
+    // Arrays are shared by every copy of a Value and only duplicated when one
+    // of the copies writes to it (copy-on-write), so copying registers, frames
+    // or a whole VM never copies array contents.
+    using ArrayRef = std::shared_ptr<std::vector<Value>>;
+    // Mapped arrays read like arrays; the first write turns the value into
+    // a plain array copy, leaving the file alone.
+    using MappedRef = std::shared_ptr<const MappedArray>;
+
+    std::variant<int32_t, double, bool, std::string, ArrayRef, std::monostate, MappedRef> data;
     int refcount = 1; // for OWN/VIEW/EDIT
 
     Value() = default;
@@ -21,7 +55,8 @@ struct Value {
     Value(double v) : data(v) {}
     Value(bool v) : data(v) {}
     Value(std::string v) : data(std::move(v)) {}
-    Value(std::vector<Value> v) : data(std::move(v)) {}
+    Value(std::vector<Value> v) : data(std::make_shared<std::vector<Value>>(std::move(v))) {}
+    Value(MappedRef m) : data(std::move(m)) {}
 
     int32_t asInt() const {
         if (std::holds_alternative<int32_t>(data)) return std::get<int32_t>(data);
@@ -42,27 +77,78 @@ struct Value {
         if (std::holds_alternative<int32_t>(data)) return std::get<int32_t>(data) != 0;
         if (std::holds_alternative<double>(data)) return std::get<double>(data) != 0.0;
         if (std::holds_alternative<std::string>(data)) return !std::get<std::string>(data).empty();
-        if (std::holds_alternative<std::vector<Value>>(data)) return !std::get<std::vector<Value>>(data).empty();
+        if (isArray()) return length() != 0;
         return false;
     }
-    std::vector<Value>& asArray() { return std::get<std::vector<Value>>(data); }
+    // true for mapped arrays as well; array() only works for plain ones
+    bool isArray() const {
+        return std::holds_alternative<ArrayRef>(data) || std::holds_alternative<MappedRef>(data);
+    }
+    bool isMapped() const { return std::holds_alternative<MappedRef>(data); }
+
+    // read access, never copies
+    const std::vector<Value>& array() const { return *std::get<ArrayRef>(data); }
+    const MappedArray& mapped() const { return *std::get<MappedRef>(data); }
+
+    // either kind of array
+    size_t length() const { return isMapped() ? mapped().count : array().size(); }
+    Value element(size_t i) const;
+
+    // write access: detaches from other holders first
+    std::vector<Value>& asArray() {
+        if (isMapped()) data = std::make_shared<std::vector<Value>>(mapped().materialize());
+        ArrayRef& a = std::get<ArrayRef>(data);
+        if (a.use_count() > 1) a = std::make_shared<std::vector<Value>>(*a);
+        return *a;
+    }
 
     std::string str() const {
         if (std::holds_alternative<int32_t>(data)) return std::to_string(asInt());
         if (std::holds_alternative<double>(data)) return std::to_string(asFloat());
         if (std::holds_alternative<bool>(data)) return asBool() ? "true" : "false";
         if (std::holds_alternative<std::string>(data)) return std::get<std::string>(data);
-        if (std::holds_alternative<std::vector<Value>>(data)) return "[array]";
+        if (isArray()) return "[array]";
         return "<unknown>";
     }
 };
 
+inline Value MappedArray::at(size_t i) const {
+    if (i >= count) throw std::out_of_range("mapped array index");
+    switch (kind) {
+        case Kind::Int32: {
+            int32_t v;
+            std::memcpy(&v, base + i * sizeof(v), sizeof(v));
+            return Value(v);
+        }
+        case Kind::Double: {
+            double v;
+            std::memcpy(&v, base + i * sizeof(v), sizeof(v));
+            return Value(v);
+        }
+        default:
+            return Value(static_cast<int32_t>(base[i]));
+    }
+}
+
+inline std::vector<Value> MappedArray::materialize() const {
+    std::vector<Value> out;
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) out.push_back(at(i));
+    return out;
+}
+
+inline Value Value::element(size_t i) const { return isMapped() ? mapped().at(i) : array().at(i); }
+
+constexpr size_t RETURN_REG = 0; // CALL results always land in regs[0]
+
 struct Instruction {
     Opcode opcode;
     uint16_t a = 0;
     uint16_t b = 0;
     uint16_t c = 0;
 };
+// the layout of one instruction in TEXT, which is what lets map() use it in place
+static_assert(sizeof(Instruction) == 8 && alignof(Instruction) <= 8, "TEXT holds raw 8-byte instructions");
 
 struct Frame {
     std::vector<Value> locals;
@@ -70,31 +156,280 @@ struct Frame {
     size_t return_pc = 0;
 };
 
+// Function boundaries as recorded by the assembler, used by the tooling
+// (profilers, disassembler) to map a pc back to the function it belongs to.
+struct FunctionSymbol {
+    std::string name;
+    uint32_t pc_start = 0;
+    uint32_t pc_end = 0;     // one past the last instruction
+    uint16_t params = 0;
+    uint16_t locals = 0;
+};
+
+// std::stack over contiguous storage; frames() gives the sampling profiler
+// read-only access to the whole chain.
+struct CallStack : std::stack<Frame, std::vector<Frame>> {
+    const std::vector<Frame>& frames() const { return c; }
+};
 
+struct LabelSymbol {
+    std::string name;
+    uint32_t pc = 0;
+};
 
 
+
+
+// The instructions of a Program: a vector of its own, or a view of the
+// TEXT section of a mapped image that the Program keeps alive (map()).
+class Code {
+public:
+    Code() = default;
+    Code(const Code& o) { *this = o; }
+    Code& operator=(const Code& o) {
+        if (this != &o) {
+            owned_ = o.owned_;
+            data_ = o.viewing() ? o.data_ : owned_.data();
+            size_ = o.size_;
+        }
+        return *this;
+    }
+
+    void assign(std::vector<Instruction> code) {
+        owned_ = std::move(code);
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+    // `code` must outlive this (see Program::image)
+    void view(const Instruction* code, size_t n) {
+        owned_.clear();
+        data_ = code;
+        size_ = n;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const Instruction* data() const { return data_; }
+    const Instruction& operator[](size_t i) const { return data_[i]; }
+    const Instruction* begin() const { return data_; }
+    const Instruction* end() const { return data_ + size_; }
+
+private:
+    bool viewing() const { return size_ && data_ != owned_.data(); }
+
+    std::vector<Instruction> owned_;
+    const Instruction* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct LazyImage;
+
+// A loaded executable: code, constants and symbols. Never modified after
+// load() beyond the lazy decoding behind enter(), which locks on its own,
+// so any number of VMs, on any number of threads, can share one through
+// the shared_ptr without copying or locking.
+struct Program {
+    // 2: TEXT starts at a multiple of TEXT_ALIGN, so map() can run it in place
+    // 3: a section directory with checksums and a function index (dvm_format.hpp)
+    static constexpr uint64_t CURRENT_VERSION = 3;
+    static constexpr size_t TEXT_ALIGN = 8;
+
+    Code code;
+    // Complete unless the Program came lazily from map(); then only the
+    // constants of entered functions are there yet (see enter()).
+    mutable std::vector<Value> constant_pool;
+    std::vector<FunctionSymbol> functions; // sorted by pc_start, may be empty
+    std::vector<LabelSymbol> labels;       // sorted by pc, may be empty
+    std::vector<std::string> natives;      // CALLN imports by index (natives.hpp)
+
+    // Parses a .dvm image. The SYMS section is skipped unless with_symbols is set.
+    static std::shared_ptr<const Program> load(const std::vector<uint8_t>& data, bool with_symbols = false);
+    // Same from a file, but mapped rather than read: the TEXT of a version 2
+    // image is used in place, so startup costs the pages touched instead of
+    // a copy of the whole file. Older images are decoded as by load().
+    // Both also take a compressed file (lz.hpp), unpacked whole into memory
+    // before parsing: map() then costs a full copy, with TEXT used in place
+    // in that copy and nothing left to gain from lazy function loading.
+    static std::shared_ptr<const Program> map(const std::string& path, bool with_symbols = false);
+
+    // The mapping `code` points into, when it came from map().
+    std::shared_ptr<const MappedFile> image;
+
+    // Function containing `at`, or nullptr when there is no symbol for it.
+    const FunctionSymbol* functionAt(size_t at) const;
+
+    // A version 3 image from map() is loaded lazily: only the top-level code
+    // is checked and has its constants decoded up front, and each function
+    // is checked against its FIDX checksum and gets its constants on first
+    // entry.
+    // CALL, SPAWN and VM::call go through here; a no-op once it has run.
+    void enter(size_t pc) const {
+        if (entered_ && pc < code.size() && !entered_[pc].load(std::memory_order_acquire))
+            materialize(pc);
+    }
+    // Every function at once, e.g. before the whole pool is needed.
+    void materializeAll() const;
+
+    // Loader state behind enter(); both null once nothing is left to load lazily.
+    std::shared_ptr<LazyImage> lazy_;
+    std::atomic<uint8_t>* entered_ = nullptr; // one flag per pc, owned by lazy_
+
+private:
+    void materialize(size_t pc) const;
+};
+
+
+enum class RunStatus { Finished, Preempted, OutOfFuel, Pending };
+
+struct FuelTable;
+class Scheduler;
+class ChannelTable;
+class SharedArrays;
+struct Native;
+class IoService;
+
+// Mutable execution state only; the program itself is shared.
 class VM {
 public:
-    std::vector<Instruction> code;
+    std::shared_ptr<const Program> program;
     std::vector<Value> regs;
     std::vector<Value> params;
-    std::stack<Frame> callstack;
-    std::vector<Value> constant_pool;
+    CallStack callstack;
+    bool load_symbols = false;             // decode SYMS in loadProgram instead of skipping it
     size_t pc = 0;
+    std::ostream* out = &std::cout;        // where PRINT and the VM's own chatter go
+
+    // With stop_at_checkpoint set, CHECKPOINT ends the run and records where
+    // to carry on (snapshots); otherwise it does nothing.
+    bool stop_at_checkpoint = false;
+    bool checkpointed = false;
+    size_t checkpoint_pc = 0;
+
+    // Fibers: the Scheduler running this VM, which SPAWN hands new fibers
+    // to. A JOIN on a fiber that has not returned yet stores its id in
+    // `joining` and ends the slice; the scheduler parks the VM until then.
+    // A CHSEND/CHRECV that cannot go ahead stores the scheduler's count of
+    // channel moves it saw before trying in `channel_wait` instead, and is
+    // parked until some channel moves after that.
+    Scheduler* scheduler = nullptr;
+    int32_t joining = -1;
+    int64_t channel_wait = -1;
+    // SPAWN without a scheduler is an error unless spawn_suspends is set:
+    // then the VM stops just before the SPAWN with needs_scheduler set, for
+    // the host to hand it to a Scheduler, where the SPAWN runs again. So a
+    // host need not know up front whether a program uses fibers.
+    bool spawn_suspends = false;
+    bool needs_scheduler = false;
+
+    // Channels (channel.hpp) that CHNEW adds to and channel ids refer to.
+    // Shared with fibers this VM spawns and with every VM of a Scheduler;
+    // created on first CHNEW when the host did not set one.
+    std::shared_ptr<ChannelTable> channels;
+    // Same for the shared int arrays of SHNEW (shared_array.hpp).
+    std::shared_ptr<SharedArrays> shared;
+
+    // The program's CALLN imports bound to host functions (natives.hpp).
+    // Bound against NativeRegistry::builtins() on the first CALLN if unset.
+    std::shared_ptr<const std::vector<Native>> natives;
+
+    // FREAD/FWRITE hand their request to `io` (io_service.hpp) and suspend
+    // the VM until it completes; io_ticket is the request in flight, -1
+    // when there is none. IoService::global() is used if unset.
+    std::shared_ptr<IoService> io;
+    int64_t io_ticket = -1;
+
+    // Set while op_enter/op_leave reshape the callstack, so an asynchronous
+    // sampler never walks a vector that is being reallocated.
+    volatile std::sig_atomic_t frames_busy = 0;
 
     VM(size_t reg_count = 8);
+    explicit VM(std::shared_ptr<const Program> program, size_t reg_count = 8);
 
     void run();
+    void resume(); // like run(), but from the current pc and frames
+
+    // Budgeted execution: stops once the program ends or about `budget`
+    // instructions have run, whichever comes first. The budget is only
+    // checked on back-edges, calls and returns, each paying for the
+    // straight-line stretch since the previous one, so the instructions in
+    // between run exactly as in run(). Continue a Preempted VM with
+    // resume(budget). A VM waiting on FREAD/FWRITE returns Pending instead
+    // of blocking; resume it once io->whenDone(io_ticket, ...) fires. One
+    // blocked on CHSEND/CHRECV outside a Scheduler returns Preempted, for
+    // the host to resume once another thread's VM has moved the channel.
+    // run()/resume() without a budget, call() and runObserved() have no
+    // caller to hand either to, so they wait themselves.
+    RunStatus run(uint64_t budget);
+    RunStatus resume(uint64_t budget);
+
+    // Metered execution (fuel.hpp): each basic block is paid for from `fuel`
+    // on entry. When the next block costs more than is left, returns
+    // OutOfFuel with nothing of that block executed; top up `fuel` and call
+    // again to continue. Per-element charges, and the function calls PARMAP
+    // and PARREDUCE make, may leave `fuel` negative.
+    int64_t fuel = 0;
+    RunStatus resumeMetered(const FuelTable& table);
     void step();
     void dispatch(const Instruction& inst);
+    // Shorthand for program = Program::load(data, load_symbols).
     void loadProgram(const std::vector<uint8_t>& data);
+    // Shorthand for program = Program::map(path, load_symbols).
+    void loadProgram(const std::string& path);
+
+    // Same loop as run(), but calls obs.before()/obs.after() around every
+    // instruction. Defined in observed_run.hpp so that only the instrumented
+    // modes pay for it.
+    template <typename Observer>
+    void runObserved(Observer& obs);
+
+    // Independent copy of this VM: same program, pc, registers, params and
+    // frames. Arrays are shared copy-on-write, so the cost is proportional to
+    // the number of live values, not to the size of the heap.
+    VM fork() const;
+
+    // Invoke one function as the outermost frame and run until it returns.
+    // Only per-call state (pc, registers, frames, params) is reset, so a
+    // loaded VM can be called over and over.
+    Value call(const FunctionSymbol& fn, const Value* args, size_t argc);
+
+    const FunctionSymbol* functionAt(size_t at) const {
+        return program ? program->functionAt(at) : nullptr;
+    }
 
 private:
     using OpFn = void(VM::*)(const Instruction&);
     std::unordered_map<Opcode, OpFn> op_table;
     std::array<OpFn, 0x100> dispatch_table{};
 
-    const uint64_t CURRENT_VM_VERSION = 1;
+    int64_t budget_ = INT64_MAX;
+    int64_t element_cost_ = 0;  // fuel per array element while metered, else 0
+    const FuelTable* metered_ = nullptr; // the table while metered, passed on to helper VMs
+    Scheduler* caller_scheduler_ = nullptr; // a PARMAP helper's caller's, told about channel moves
+    size_t segment_ = 0;        // pc the current straight-line stretch started at
+    bool preempted_ = false;
+    size_t preempt_pc_ = 0;     // where a preempted run continues
+    bool rerun_paid_ = false;   // the instruction at preempt_pc_ runs again, its fuel already paid
+
+    void loop();
+    bool runBlocks(const FuelTable& table, bool prepaid);
+    bool waitToResume();
+
+    // Taken jumps go through here so that only back-edges pay the budget.
+    void jumpTo(size_t target) {
+        if (target <= pc) branch(target);
+        else pc = target;
+    }
+    void branch(size_t target) {
+        budget_ -= static_cast<int64_t>(pc - segment_ + 1);
+        segment_ = target;
+        pc = target;
+        if (budget_ <= 0 && target < program->code.size()) {
+            preempted_ = true;
+            preempt_pc_ = target;
+            pc = program->code.size(); // leave the dispatch loop
+        }
+    }
+
     void setupDispatchTable();
     void setupOpTable();
 
@@ -133,6 +468,34 @@ private:
     void op_leave(const Instruction&);
     void op_nop(const Instruction&);
     void op_halt(const Instruction&);
+    void op_checkpoint(const Instruction&);
+
+    void op_spawn(const Instruction&);
+    void op_yield(const Instruction&);
+    void op_join(const Instruction&);
+
+    void op_chnew(const Instruction&);
+    void op_chsend(const Instruction&);
+    void op_chrecv(const Instruction&);
+    void op_chtry(const Instruction&);
+    void waitOnChannel(const char* op, const Value& id, uint64_t seen);
+
+    void op_shnew(const Instruction&);
+    void op_aload(const Instruction&);
+    void op_astore(const Instruction&);
+    void op_afetchadd(const Instruction&);
+    void op_acas(const Instruction&);
+    void op_fence(const Instruction&);
+
+    void op_parmap(const Instruction&);
+    void op_parreduce(const Instruction&);
+    VM helper() const; // fresh VM on the same program, output and shared objects
+
+    void op_calln(const Instruction&);
+
+    void op_fread(const Instruction&);
+    void op_fwrite(const Instruction&);
+    void awaitIo(uint16_t dst);
 
 
     void op_own(const Instruction&);
@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace detvm::dvm {
+
+// .dvm from version 3 on:
+//
+//   "DTVM"  u64 version
+//   "SDIR"  u32 count, then `count` Section entries
+//   the sections, each where its entry says; TEXT at a multiple of
+//   Program::TEXT_ALIGN
+//
+//   POOL  size_t count, then per constant: u8 type, size_t size, payload
+//   CIDX  u64 offset into POOL of each constant, so one can be decoded alone
+//   TEXT  the instructions, exactly as in memory
+//   FIDX  u32 count, then a FunctionEntry per function, sorted by pc_start
+//   ENTR  u32 checksum of the code outside every function, see entryChecksum()
+//         (absent in early version 3 files)
+//   NATV  u32 count, then u32 length + name per CALLN import   (optional)
+//   SYMS  function and label names                              (optional)
+//
+// Loaders can verify any section against its checksum without decoding it,
+// every function's code against its FIDX entry on its own, and the rest of
+// TEXT, which runs before any function is entered, against ENTR.
+struct Section {
+    char tag[4];
+    uint32_t checksum;
+    uint64_t offset;
+    uint64_t size;
+};
+static_assert(sizeof(Section) == 24, "section entries are written as-is");
+
+struct FunctionEntry {
+    uint32_t pc_start;
+    uint32_t pc_end; // one past the last instruction
+    uint32_t checksum;
+};
+static_assert(sizeof(FunctionEntry) == 12, "FIDX entries are written as-is");
+
+// FNV-1a: cheap enough to run over a function on its first call
+// (pass a previous result as `h` to carry on over more bytes)
+inline uint32_t checksum(const void* data, size_t size, uint32_t h = 2166136261u) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// One checksum over every stretch of TEXT no FIDX entry covers, in pc order.
+template <typename Instruction>
+uint32_t entryChecksum(const Instruction* code, size_t n, const std::vector<FunctionEntry>& functions) {
+    uint32_t h = checksum(nullptr, 0);
+    size_t pc = 0;
+    for (const auto& fn : functions) {
+        if (fn.pc_start > pc) h = checksum(code + pc, (fn.pc_start - pc) * sizeof(Instruction), h);
+        pc = std::max<size_t>(pc, fn.pc_end);
+    }
+    if (n > pc) h = checksum(code + pc, (n - pc) * sizeof(Instruction), h);
+    return h;
+}
+
+} // namespace detvm::dvm
@@ -0,0 +1,33 @@
+#pragma once
+#include "detvm.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace detvm {
+
+// Ready-made forks of a warmed-up VM, one per request. The pool keeps its
+// own fork of the parent as the template, so the parent may go on running.
+// acquire() hands out a prepared clone, or forks on the spot when the pool
+// is empty; refill() tops it back up and is meant for idle time.
+//
+// A resumed clone carries on from the parent's pc (e.g. right after the
+// CHECKPOINT it stopped at); see VM::resume().
+class ForkPool {
+public:
+    ForkPool(const VM& parent, size_t capacity);
+
+    std::unique_ptr<VM> acquire();
+    void refill();
+
+    size_t available() const;
+    size_t capacity() const { return capacity_; }
+
+private:
+    VM template_;
+    size_t capacity_;
+    mutable std::mutex m_;
+    std::vector<std::unique_ptr<VM>> ready_;
+};
+
+} // namespace detvm
@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <vector>
+#include "detvm.hpp"
+
+namespace detvm {
+
+// Deterministic cost model (detvm --fuel). Every opcode has a fixed cost,
+// and operations over many elements (NEWARR, PARMAP, PARREDUCE) add a cost
+// per element, PARMAP and PARREDUCE on top of the calls they make. Charges
+// depend only on the program and its inputs, never on host speed, so the
+// fuel a run consumed can be billed and reproduced exactly.
+struct FuelSchedule {
+    std::array<uint32_t, 0x100> cost;
+    uint32_t per_element = 1;
+
+    FuelSchedule() { cost.fill(1); }
+
+    // Text overrides, one per line: "<MNEMONIC> <cost>" or
+    // "per_element <cost>"; ';' starts a comment.
+    static FuelSchedule parse(std::istream& in);
+};
+
+// Per-program charges, computed once at load time: for every pc, the end of
+// its basic block and the cost of the rest of that block. The metered loop
+// pays for a whole block on entry instead of instruction by instruction.
+// Immutable, so VMs sharing a Program can share one table too.
+struct FuelTable {
+    std::vector<uint32_t> block_end;
+    std::vector<int64_t> cost;
+    int64_t per_element = 1;
+
+    static FuelTable build(const Program& program, const FuelSchedule& schedule);
+};
+
+} // namespace detvm
@@ -0,0 +1,89 @@
+#pragma once
+#include "detvm.hpp"
+#include "thread_pool.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace detvm {
+
+// Asynchronous whole-file I/O for FREAD/FWRITE. Requests run on a small
+// pool of I/O threads and are identified by a ticket; the VM that issued
+// one suspends (RunStatus::Pending) instead of blocking its thread, and
+// whoever drives it resumes it once whenDone() fires.
+class IoService {
+public:
+    explicit IoService(size_t threads = 2);
+
+    IoService(const IoService&) = delete;
+    IoService& operator=(const IoService&) = delete;
+
+    // Whole file as a string.
+    int64_t read(const std::string& path);
+    // Replaces the file with `data`; the result is the number of bytes written.
+    int64_t write(const std::string& path, std::string data);
+
+    // Moves the result of a finished request into `out` and forgets the
+    // ticket; false while it is in flight. Rethrows a failed request.
+    bool take(int64_t ticket, Value& out);
+    // Blocks until the request is done.
+    void wait(int64_t ticket);
+    // Runs fn once the request is done: right here if it already is,
+    // otherwise on the I/O thread that completes it.
+    void whenDone(int64_t ticket, std::function<void()> fn);
+
+    // Used by VMs the host did not give one.
+    static const std::shared_ptr<IoService>& global();
+
+private:
+    struct Request {
+        bool done = false;
+        Value result;
+        std::string error;
+        std::function<void()> then;
+    };
+
+    int64_t submit(std::function<Value()> work);
+
+    std::mutex m_;
+    std::condition_variable done_;
+    std::unordered_map<int64_t, Request> requests_;
+    int64_t next_ = 0;
+    ThreadPool pool_; // last: its threads stop before the table goes; they block SIGPROF
+};
+
+// Event loop driving many VMs from the calling thread alone. Each runs in
+// slices of `slice` instructions; one that is waiting on FREAD/FWRITE sits
+// out until its request completes, so the disk latency of every VM
+// overlaps while the thread keeps running whichever are ready.
+class IoLoop {
+public:
+    explicit IoLoop(uint64_t slice = 10000) : slice_(slice ? slice : 1) {}
+
+    // Takes the VM; it starts from its current pc on the next run().
+    size_t add(std::unique_ptr<VM> vm);
+    // Until every VM has finished. A VM's error propagates out of here.
+    void run();
+
+    VM& vm(size_t id) { return *vms_.at(id); }
+    uint64_t slices() const { return slices_; }
+
+private:
+    uint64_t slice_;
+    std::vector<std::unique_ptr<VM>> vms_;
+    std::deque<size_t> ready_;
+    size_t waiting_ = 0;  // suspended on I/O
+
+    std::mutex m_;
+    std::condition_variable wake_;
+    std::vector<size_t> completed_; // finished I/O, filled from I/O threads
+    uint64_t slices_ = 0;
+};
+
+} // namespace detvm
@@ -0,0 +1,27 @@
+#pragma once
+#include "detvm.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace detvm {
+
+// Batch mode (detvm --jobs N): the entry function is called once per input
+// line, on a work-stealing pool with one VM per worker over the shared
+// Program. Output comes back in input order no matter which job finishes
+// first: whatever the call PRINTed, then its return value.
+struct JobOptions {
+    size_t threads = 0;          // 0: one per hardware thread
+    std::string entry = "main";
+};
+
+// One argument token: an int, a double, true/false, otherwise a string.
+Value parseValue(const std::string& token);
+// Whitespace-separated tokens of one input line.
+std::vector<Value> parseArgs(const std::string& line);
+
+// Returns how many inputs failed; their slot in the output says why.
+size_t runJobs(std::shared_ptr<const Program> program, const JobOptions& opt,
+               const std::vector<std::string>& inputs, std::ostream& out);
+
+} // namespace detvm
@@ -24,11 +24,13 @@ struct ObjectFile {
 assembler::AssemblerResult readObject(const std::string& path);
 
 
-// resolve all unresolved jumps/calls using the label table
+// resolve all unresolved jumps/calls using the label table; CALLN names
+// become indices into `natives`, which the host binds at load time
 void linkLabels(std::vector<detvm::Instruction>& code,
                 const std::unordered_map<std::string, size_t>& label_to_pc,
                 const std::vector<assembler::UnresolvedJump>& unresolved,
-                const std::unordered_map<std::string, assembler::Function>& funcs);
+                const std::unordered_map<std::string, assembler::Function>& funcs,
+                std::vector<std::string>* natives = nullptr);
 
 assembler::AssemblerResult linkObjects(const std::vector<assembler::AssemblerResult>& objects);
 
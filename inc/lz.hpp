@@ -0,0 +1,304 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Optional compressed container for .dvm and .dto files (detasm/detld
+// --compress). Everything that reads those files accepts either form.
+//
+//   "DTLZ"  u64 size of the original file
+//   blocks of at most BLOCK_SIZE original bytes, each
+//       u32 original size, u32 packed size, packed bytes
+//   (a block whose packed size equals its original size is stored as-is)
+//
+// A packed block is a series of sequences, LZ4 style:
+//   token   u8: literal count << 4 | (match length - MIN_MATCH), 15 = more follows
+//   [u8...] rest of the literal count, 255 meaning more again
+//   literals
+//   u16     little-endian distance back to the match  } absent after the
+//   [u8...] rest of the match length                   } last literals
+//
+// Tuned for the instruction stream: instructions are 8 bytes with mostly
+// small operands, so besides the usual hash lookup the encoder tries the
+// instruction one and two back, where repeats are most common.
+namespace detvm::lz {
+
+constexpr char MAGIC[4] = {'D', 'T', 'L', 'Z'};
+constexpr size_t HEADER_SIZE = 4 + sizeof(uint64_t);
+constexpr size_t BLOCK_SIZE = 64 * 1024; // keeps every distance within a u16
+constexpr size_t MIN_MATCH = 4;
+
+inline bool isCompressed(const uint8_t* data, size_t size) {
+    return size >= HEADER_SIZE && std::memcmp(data, MAGIC, 4) == 0;
+}
+
+namespace detail {
+
+inline void putLength(std::vector<uint8_t>& out, size_t n) {
+    for (; n >= 255; n -= 255) out.push_back(255);
+    out.push_back(static_cast<uint8_t>(n));
+}
+
+inline uint32_t load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void emit(std::vector<uint8_t>& out, const uint8_t* lit, size_t lit_len, size_t dist, size_t match_len) {
+    const size_t m = match_len ? match_len - MIN_MATCH : 0;
+    out.push_back(static_cast<uint8_t>((lit_len < 15 ? lit_len : 15) << 4 | (m < 15 ? m : 15)));
+    if (lit_len >= 15) putLength(out, lit_len - 15);
+    out.insert(out.end(), lit, lit + lit_len);
+    if (!match_len) return;
+    out.push_back(static_cast<uint8_t>(dist));
+    out.push_back(static_cast<uint8_t>(dist >> 8));
+    if (m >= 15) putLength(out, m - 15);
+}
+
+} // namespace detail
+
+// Appends one packed block; `size` must not exceed BLOCK_SIZE.
+inline void compressBlock(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+    constexpr size_t HASH_BITS = 12;
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+    auto hash = [](uint32_t v) { return (v * 2654435761u) >> (32 - HASH_BITS); };
+
+    size_t anchor = 0, i = 0;
+    while (i + MIN_MATCH <= size) {
+        const uint32_t h = hash(detail::load32(src + i));
+        const size_t candidates[] = {table[h], i - 8, i - 16};
+        table[h] = static_cast<uint32_t>(i);
+
+        size_t best_len = 0, best_at = 0;
+        for (size_t c : candidates) {
+            if (c >= i) continue; // unset, or before the block start (wrapped)
+            size_t n = 0;
+            while (i + n < size && src[c + n] == src[i + n]) ++n;
+            if (n > best_len) best_len = n, best_at = c;
+        }
+        if (best_len < MIN_MATCH) {
+            ++i;
+            continue;
+        }
+        detail::emit(out, src + anchor, i - anchor, i - best_at, best_len);
+        i += best_len;
+        anchor = i;
+    }
+    if (anchor < size) detail::emit(out, src + anchor, size - anchor, 0, 0);
+}
+
+// Unpacks one block into exactly `out_size` bytes; throws on malformed input.
+inline void decompressBlock(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size) {
+    const uint8_t* ip = in;
+    const uint8_t* const iend = in + in_size;
+    uint8_t* op = out;
+    uint8_t* const oend = out + out_size;
+    auto corrupt = [] { throw std::runtime_error("corrupt compressed block"); };
+    auto length = [&](size_t n) {
+        if (n != 15) return n;
+        for (uint8_t b = 255; b == 255; n += b) {
+            if (ip == iend) corrupt();
+            b = *ip++;
+        }
+        return n;
+    };
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        const size_t lit = length(token >> 4);
+        if (lit > static_cast<size_t>(iend - ip) || lit > static_cast<size_t>(oend - op)) corrupt();
+        std::memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == iend) break;
+
+        if (iend - ip < 2) corrupt();
+        const size_t dist = ip[0] | size_t(ip[1]) << 8;
+        ip += 2;
+        const size_t len = length(token & 15) + MIN_MATCH;
+        if (dist == 0 || dist > static_cast<size_t>(op - out) || len > static_cast<size_t>(oend - op)) corrupt();
+        // byte by byte: a match may overlap the bytes it produces
+        const uint8_t* from = op - dist;
+        for (size_t k = 0; k < len; ++k) *op++ = from[k];
+    }
+    if (op != oend) corrupt();
+}
+
+// A whole file into a container.
+inline std::vector<uint8_t> compress(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> out(MAGIC, MAGIC + 4);
+    const uint64_t total = size;
+    out.insert(out.end(), reinterpret_cast<const uint8_t*>(&total), reinterpret_cast<const uint8_t*>(&total + 1));
+
+    std::vector<uint8_t> packed;
+    for (size_t at = 0; at < size; at += BLOCK_SIZE) {
+        const uint32_t raw = static_cast<uint32_t>(std::min(BLOCK_SIZE, size - at));
+        packed.clear();
+        compressBlock(data + at, raw, packed);
+        const bool stored = packed.size() >= raw;
+        const uint32_t packed_size = stored ? raw : static_cast<uint32_t>(packed.size());
+        out.insert(out.end(), reinterpret_cast<const uint8_t*>(&raw), reinterpret_cast<const uint8_t*>(&raw + 1));
+        out.insert(out.end(), reinterpret_cast<const uint8_t*>(&packed_size),
+                   reinterpret_cast<const uint8_t*>(&packed_size + 1));
+        if (stored) out.insert(out.end(), data + at, data + at + raw);
+        else out.insert(out.end(), packed.begin(), packed.end());
+    }
+    return out;
+}
+
+// A whole container back into the original bytes, block by block.
+inline std::vector<uint8_t> decompress(const uint8_t* data, size_t size) {
+    if (!isCompressed(data, size)) throw std::runtime_error("not a compressed container");
+    uint64_t total;
+    std::memcpy(&total, data + 4, sizeof(total));
+    // every block takes at least its 8-byte header, so a size the rest of
+    // the container cannot hold is refused before anything is allocated
+    const uint64_t blocks = total / BLOCK_SIZE + (total % BLOCK_SIZE != 0);
+    if (blocks > (size - HEADER_SIZE) / (2 * sizeof(uint32_t)))
+        throw std::runtime_error("truncated compressed container");
+
+    std::vector<uint8_t> out(total);
+    size_t at = HEADER_SIZE, done = 0;
+    while (done < total) {
+        uint32_t raw, packed;
+        if (size - at < 2 * sizeof(uint32_t)) throw std::runtime_error("truncated compressed container");
+        std::memcpy(&raw, data + at, sizeof(raw));
+        std::memcpy(&packed, data + at + sizeof(raw), sizeof(packed));
+        at += 2 * sizeof(uint32_t);
+        if (packed > size - at || raw == 0 || raw > total - done || raw > BLOCK_SIZE)
+            throw std::runtime_error("truncated compressed container");
+        if (packed == raw) std::memcpy(out.data() + done, data + at, raw);
+        else decompressBlock(data + at, packed, out.data() + done, raw);
+        at += packed;
+        done += raw;
+    }
+    return out;
+}
+
+// Reads a container as the original bytes, unpacking one block at a time
+// as the reader gets to it. Seeks work too: forward by unpacking up to the
+// target, backward by starting over from the first block.
+class Decoder : public std::streambuf {
+public:
+    // `src` is positioned just after the magic and must outlive this; a
+    // header cut short reads as an empty file
+    explicit Decoder(std::istream& src) : src_(src) {
+        if (!src_.read(reinterpret_cast<char*>(&size_), sizeof(size_))) size_ = 0;
+        first_ = src_.tellg();
+    }
+
+    uint64_t size() const { return size_; }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (!nextBlock()) return traits_type::eof();
+        return traits_type::to_int_type(*gptr());
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        off_type base = dir == std::ios_base::beg ? 0
+                      : dir == std::ios_base::end ? static_cast<off_type>(size_)
+                      : static_cast<off_type>(start_ + (gptr() - eback()));
+        return seekpos(pos_type(base + off), which);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode) override {
+        const off_type target = pos;
+        if (target < 0 || static_cast<uint64_t>(target) > size_) return pos_type(off_type(-1));
+        const uint64_t to = static_cast<uint64_t>(target);
+        if (to < start_) { // start over
+            src_.clear();
+            src_.seekg(first_);
+            start_ = 0;
+            block_.clear();
+            setg(nullptr, nullptr, nullptr);
+        }
+        while (to >= start_ + block_.size() && start_ + block_.size() < size_)
+            if (!nextBlock()) return pos_type(off_type(-1));
+        char* base = block_.data();
+        setg(base, base + (to - start_), base + block_.size());
+        return pos;
+    }
+
+private:
+    bool nextBlock() {
+        start_ += block_.size();
+        block_.clear();
+        setg(nullptr, nullptr, nullptr);
+        if (start_ >= size_) return false;
+
+        uint32_t raw, packed_size;
+        src_.read(reinterpret_cast<char*>(&raw), sizeof(raw));
+        src_.read(reinterpret_cast<char*>(&packed_size), sizeof(packed_size));
+        // a block never packs larger than it is, so neither buffer outgrows BLOCK_SIZE
+        if (!src_ || raw == 0 || raw > BLOCK_SIZE || raw > size_ - start_ || packed_size > raw)
+            throw std::runtime_error("truncated compressed container");
+
+        block_.resize(raw);
+        packed_.resize(packed_size);
+        src_.read(packed_.data(), packed_size);
+        if (!src_) throw std::runtime_error("truncated compressed container");
+        if (packed_size == raw) block_.swap(packed_);
+        else decompressBlock(reinterpret_cast<const uint8_t*>(packed_.data()), packed_size,
+                             reinterpret_cast<uint8_t*>(block_.data()), raw);
+        setg(block_.data(), block_.data(), block_.data() + block_.size());
+        return true;
+    }
+
+    std::istream& src_;
+    std::streampos first_;
+    uint64_t size_ = 0;
+    uint64_t start_ = 0; // offset of block_ in the original bytes
+    std::vector<char> block_, packed_;
+};
+
+// A file opened for binary reading, decompressed on the fly when it is a
+// container and read directly otherwise.
+class InputFile : public std::istream {
+public:
+    explicit InputFile(const std::string& path) : std::istream(nullptr), file_(path, std::ios::binary) {
+        rdbuf(file_.rdbuf());
+        exceptions(std::ios::badbit); // so a corrupt block surfaces as its own error
+        if (!file_) {
+            setstate(std::ios::failbit);
+            return;
+        }
+        char magic[4] = {};
+        file_.read(magic, 4);
+        if (file_.gcount() == 4 && std::memcmp(magic, MAGIC, 4) == 0) {
+            decoder_ = std::make_unique<Decoder>(file_);
+            rdbuf(decoder_.get());
+        } else {
+            file_.clear();
+            file_.seekg(0);
+        }
+    }
+
+    bool compressed() const { return decoder_ != nullptr; }
+    // size of the original file when compressed()
+    uint64_t unpackedSize() const { return decoder_ ? decoder_->size() : 0; }
+    // size on disk
+    std::streamoff packedSize() {
+        std::streampos at = file_.tellg();
+        file_.seekg(0, std::ios::end);
+        std::streamoff n = file_.tellg();
+        file_.seekg(at);
+        return n;
+    }
+
+private:
+    std::ifstream file_;
+    std::unique_ptr<Decoder> decoder_;
+};
+
+} // namespace detvm::lz
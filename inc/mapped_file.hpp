@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace detvm {
+
+// Read-only view of a whole file. mmap()ed where available, so opening a
+// large file costs no copy; elsewhere the file is simply read into memory.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    // Bytes already in memory, e.g. an unpacked compressed file.
+    explicit MappedFile(std::vector<uint8_t> bytes);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> fallback_;
+};
+
+} // namespace detvm
@@ -0,0 +1,40 @@
+#pragma once
+#include "detvm.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace detvm {
+
+// Host functions callable with CALLN. They read their arguments straight
+// from the caller's %p registers and return the value that lands in %r0.
+using NativeFn = Value (*)(const Value* args, size_t argc);
+
+struct Native {
+    NativeFn fn = nullptr;
+    uint16_t params = 0;
+};
+
+// Name -> host function. detld turns every `CALLN name` into an index into
+// the program's import list (the NATV section); bind() maps that list onto
+// a registry once, so a CALLN is an array lookup and an indirect call.
+class NativeRegistry {
+public:
+    void add(const std::string& name, NativeFn fn, uint16_t params);
+    const Native* find(const std::string& name) const;
+
+    // One entry per program import, in import order; throws naming the first
+    // import nothing was registered for.
+    std::vector<Native> bind(const Program& program) const;
+
+    // fnv1a(x), parse_int(s), sqrt(x) and map_i32/map_f64/map_bytes(path)
+    // (a file as a read-only MappedArray): what a VM binds when its host
+    // did not bind anything itself.
+    static const NativeRegistry& builtins();
+
+private:
+    std::unordered_map<std::string, Native> table_;
+};
+
+} // namespace detvm
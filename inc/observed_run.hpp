@@ -0,0 +1,32 @@
+#pragma once
+#include "detvm.hpp"
+
+namespace detvm {
+
+// Instrumented copy of VM::run(). Each mode that needs per-instruction data
+// (profiler, opcode statistics, ...) instantiates this with its own observer
+// in its own translation unit, so the plain dispatch loop stays untouched.
+//
+// Observer interface:
+//   void before(VM& vm, size_t pc, const Instruction& inst);
+//   void after(VM& vm, size_t pc, const Instruction& inst);
+template <typename Observer>
+void VM::runObserved(Observer& obs) {
+    if (!program) throw std::runtime_error("no program loaded");
+    const Code& code = program->code;
+    pc = 0;
+    preempted_ = false;
+    budget_ = INT64_MAX;
+    segment_ = pc;
+    do {
+        while (pc < code.size()) {
+            const size_t at = pc;
+            const Instruction inst = code[at];
+            obs.before(*this, at, inst);
+            dispatch(inst);
+            obs.after(*this, at, inst);
+        }
+    } while (waitToResume());
+}
+
+} // namespace detvm
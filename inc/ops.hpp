@@ -68,6 +68,7 @@ enum class Opcode : uint16_t {
     HALT    = 0x52, // stop execution
     LOADP   = 0x53, // load parameter 
     LOADLP  = 0x54, // load parameter from local
+    CHECKPOINT = 0x55, // snapshot point; a no-op unless the host asked to stop here
     // Ownership & Borrowing
     OWN     = 0x60, // dest, type_id, flags
     MOVE    = 0x61, // dest, src, flags=0
@@ -81,7 +82,133 @@ enum class Opcode : uint16_t {
     DECREF      = 0x71, // decrement refcount
     CHECKEXCL   = 0x72, // ensure exclusive (→edit) ref before writing
     CHECKLIVE   = 0x73, // verify reference is still alive
-    RAIIDROP    = 0x74  // auto-drop owned value at scope exit
+    RAIIDROP    = 0x74, // auto-drop owned value at scope exit
+
+    // Fibers (need a Scheduler)
+    SPAWN   = 0x80, // A=func_pc, B=argc, C=locals (CALL layout); fiber id -> r0
+    YIELD   = 0x81, // give up the rest of the time slice
+    JOIN    = 0x82, // A=fiber id reg; waits for it, its return value -> r0
+
+    // Channels
+    CHNEW   = 0x83, // A=dst, C=capacity
+    CHSEND  = 0x84, // A=channel, B=value (moved out, waits while full)
+    CHRECV  = 0x85, // A=dst, B=channel (waits while empty)
+    CHTRY   = 0x86, // A=dst, B=channel, C=ok flag; never waits
+
+    // Shared int arrays (atomic access)
+    SHNEW     = 0x88, // A=dst, C=len
+    ALOAD     = 0x89, // A=dst, B=shared, C=index (acquire)
+    ASTORE    = 0x8A, // A=shared, B=index, C=value (release)
+    AFETCHADD = 0x8B, // A=delta in / old value out, B=shared, C=index
+    ACAS      = 0x8C, // A=desired in / ok out, B=shared, C=index; r0=expected in / seen out
+    FENCE     = 0x8D, // sequentially consistent fence
+
+    // Data-parallel calls (CALL layout; array in p0, result -> r0)
+    PARMAP    = 0x90, // r0 = [func(x) for x in p0]
+    PARREDUCE = 0x91, // r0 = func(...func(func(p1, x0), x1)..., xn); func must be associative
+
+    // Host functions
+    CALLN     = 0x92, // A=native import index; args from p0.., result -> r0
+
+    // Asynchronous file I/O (the VM suspends until the request completes)
+    FREAD     = 0x93, // A=dst (file contents), B=path
+    FWRITE    = 0x94  // A=dst (bytes written), B=path, C=data
 };
 
+inline const char* opcodeName(Opcode op) {
+    switch (op) {
+        case Opcode::LOADC:    return "LOADC";
+        case Opcode::LOADL:    return "LOADL";
+        case Opcode::STOREL:   return "STOREL";
+        case Opcode::MOV:      return "MOV";
+        case Opcode::ADD:      return "ADD";
+        case Opcode::SUB:      return "SUB";
+        case Opcode::MUL:      return "MUL";
+        case Opcode::DIV:      return "DIV";
+        case Opcode::NEG:      return "NEG";
+        case Opcode::CMP:      return "CMP";
+        case Opcode::NOT:      return "NOT";
+        case Opcode::AND:      return "AND";
+        case Opcode::OR:       return "OR";
+
+        case Opcode::JMP:      return "JMP";
+        case Opcode::JZ:       return "JZ";
+        case Opcode::JNZ:      return "JNZ";
+        case Opcode::JL:       return "JL";
+        case Opcode::JG:       return "JG";
+        case Opcode::JLZ:      return "JLZ";
+        case Opcode::JLNZ:     return "JLNZ";
+        case Opcode::JLL:      return "JLL";
+        case Opcode::JLG:      return "JLG";
+
+        case Opcode::CALL:     return "CALL";
+        case Opcode::RET:      return "RET";
+        case Opcode::ENTER:    return "ENTER";
+        case Opcode::LEAVE:    return "LEAVE";
+        case Opcode::ADDL:     return "ADDL";
+        case Opcode::SUBL:     return "SUBL";
+        case Opcode::MULL:     return "MULL";
+        case Opcode::DIVL:     return "DIVL";
+        case Opcode::CMPL:     return "CMPL";
+        case Opcode::NEGL:     return "NEGL";
+        case Opcode::NOTL:     return "NOTL";
+        case Opcode::ANDL:     return "ANDL";
+        case Opcode::ORL:      return "ORL";
+        case Opcode::MOVL:     return "MOVL";
+        case Opcode::LOADCL:   return "LOADCL";
+        case Opcode::LOADARG:  return "LOADARG";
+
+        case Opcode::NEWARR:   return "NEWARR";
+        case Opcode::LOADARR:  return "LOADARR";
+        case Opcode::STOREARR: return "STOREARR";
+        case Opcode::LEN:      return "LEN";
+        case Opcode::FREE:     return "FREE";
+
+        case Opcode::TAG:      return "TAG";
+        case Opcode::WHEN:     return "WHEN";
+        case Opcode::TYPEOF:   return "TYPEOF";
+
+        case Opcode::NOP:      return "NOP";
+        case Opcode::PRINT:    return "PRINT";
+        case Opcode::HALT:     return "HALT";
+        case Opcode::LOADP:    return "LOADP";
+        case Opcode::LOADLP:   return "LOADLP";
+        case Opcode::CHECKPOINT: return "CHECKPOINT";
+
+        case Opcode::OWN:      return "OWN";
+        case Opcode::MOVE:     return "MOVE";
+        case Opcode::VIEW:     return "VIEW";
+        case Opcode::EDIT:     return "EDIT";
+        case Opcode::CLONE:    return "CLONE";
+        case Opcode::DROP:     return "DROP";
+
+        case Opcode::INCREF:    return "INCREF";
+        case Opcode::DECREF:    return "DECREF";
+        case Opcode::CHECKEXCL: return "CHECKEXCL";
+        case Opcode::CHECKLIVE: return "CHECKLIVE";
+        case Opcode::RAIIDROP:  return "RAIIDROP";
+
+        case Opcode::SPAWN:    return "SPAWN";
+        case Opcode::YIELD:    return "YIELD";
+        case Opcode::JOIN:     return "JOIN";
+        case Opcode::CHNEW:    return "CHNEW";
+        case Opcode::CHSEND:   return "CHSEND";
+        case Opcode::CHRECV:   return "CHRECV";
+        case Opcode::CHTRY:    return "CHTRY";
+        case Opcode::SHNEW:    return "SHNEW";
+        case Opcode::ALOAD:    return "ALOAD";
+        case Opcode::ASTORE:   return "ASTORE";
+        case Opcode::AFETCHADD: return "AFETCHADD";
+        case Opcode::ACAS:     return "ACAS";
+        case Opcode::FENCE:    return "FENCE";
+        case Opcode::PARMAP:   return "PARMAP";
+        case Opcode::PARREDUCE: return "PARREDUCE";
+        case Opcode::CALLN:    return "CALLN";
+        case Opcode::FREAD:    return "FREAD";
+        case Opcode::FWRITE:   return "FWRITE";
+
+        default: return "UNKNOWN";
+    }
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "detvm.hpp"
+
+namespace detvm {
+
+// Opcode statistics (detvm --opstats): executions per opcode, the most
+// frequent opcode pairs and triples, and taken/not-taken counts for every
+// conditional jump site. Only sequences of adjacent instructions (pc, pc+1,
+// ...) count as n-grams, since those are what a superinstruction can fuse.
+class OpStats {
+public:
+    explicit OpStats(const VM& vm);
+
+    // Observer hooks for VM::runObserved().
+    void before(VM& vm, size_t pc, const Instruction& inst);
+    void after(VM& vm, size_t pc, const Instruction& inst);
+
+    // JSON report; top_n limits the pair and triple lists.
+    void writeJson(std::ostream& out, size_t top_n = 32) const;
+
+private:
+    struct BranchSite {
+        Opcode op;
+        uint64_t taken = 0;
+        uint64_t not_taken = 0;
+    };
+
+    const VM& vm_;
+    uint64_t instrs_ = 0;
+    std::array<uint64_t, 0x100> counts_{};
+    std::vector<uint64_t> pairs_;                   // 0x100 * 0x100, prev << 8 | cur
+    std::unordered_map<uint32_t, uint64_t> triples_; // a << 16 | b << 8 | c
+    std::map<size_t, BranchSite> branches_;          // by pc
+    size_t last_pc_ = static_cast<size_t>(-1);
+    uint32_t run_ = 0;  // up to two previous opcodes of the current straight-line run
+    uint32_t run_len_ = 0;
+    bool taken_ = false;  // the condition of the jump about to run
+};
+
+} // namespace detvm
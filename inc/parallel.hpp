@@ -0,0 +1,19 @@
+#pragma once
+#include "thread_pool.hpp"
+#include <cstddef>
+#include <functional>
+
+namespace detvm {
+
+// Runs body(begin, end) over [0, n) split into `chunks` contiguous ranges.
+// Chunks are claimed from a shared counter by pool workers and by the
+// calling thread alike, and the caller only ever waits for chunks already
+// running elsewhere, so it is safe to call from inside a pool task (nested
+// PARMAP, or a VM on a Scheduler). Rethrows the first exception of a chunk.
+void parallelFor(ThreadPool& pool, size_t n, size_t chunks,
+                 const std::function<void(size_t begin, size_t end)>& body);
+
+// Process-wide pool for PARMAP/PARREDUCE outside a Scheduler.
+ThreadPool& defaultPool();
+
+} // namespace detvm
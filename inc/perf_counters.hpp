@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "detvm.hpp"
+
+namespace detvm {
+
+// Hardware performance counters around VM execution (detvm --perf-counters),
+// via Linux perf_event_open. Each counter is opened on its own, so a CPU or
+// kernel that lacks one event still reports the others; where nothing can be
+// opened (other OSes, containers, perf_event_paranoid) available() is false
+// and the caller just runs without counters.
+class PerfCounters {
+public:
+    enum Event { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1I_MISSES, L1D_MISSES, EVENT_COUNT };
+
+    struct Reading {
+        std::array<uint64_t, EVENT_COUNT> value{};
+        Reading operator-(const Reading& o) const;
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    bool has(Event e) const { return fds_[e] >= 0; }
+    const std::string& error() const { return error_; }
+
+    void start();
+    void stop();
+    Reading read() const;
+
+    static const char* name(Event e);
+
+private:
+    std::array<int, EVENT_COUNT> fds_;
+    std::string error_;
+};
+
+// Observer for VM::runObserved(): reads the counters every `window` VM
+// instructions and attributes each window to the opcode it executed most.
+class PerfWindows {
+public:
+    PerfWindows(PerfCounters& counters, size_t window);
+
+    void before(VM& vm, size_t pc, const Instruction& inst);
+    void after(VM&, size_t, const Instruction&) {}
+    void finish();
+
+    // totals plus per-window and per-dominant-opcode breakdowns
+    void report(std::ostream& out) const;
+
+private:
+    struct Window {
+        uint64_t vm_instrs;
+        uint8_t dominant;
+        PerfCounters::Reading delta;
+    };
+
+    void close();
+
+    PerfCounters& counters_;
+    size_t window_;
+    size_t in_window_ = 0;
+    std::array<uint32_t, 0x100> ops_{};
+    PerfCounters::Reading last_;
+    PerfCounters::Reading total_;
+    uint64_t vm_instrs_ = 0;
+    std::vector<Window> windows_;
+};
+
+// Totals-only report for a plain VM::run().
+void reportPerfTotals(std::ostream& out, const PerfCounters& counters,
+                      const PerfCounters::Reading& total);
+
+} // namespace detvm
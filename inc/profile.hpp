@@ -0,0 +1,79 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "detvm.hpp"
+
+namespace detvm {
+
+// Exact, instrumented function-level profiler (detvm --profile).
+// Counts instructions and wall time per function, caller -> callee edges and
+// per-pc hits. A function is entered when an instruction pushes a frame
+// (CALL/ENTER) and left when one pops it (RET/LEAVE).
+class Profiler {
+public:
+    explicit Profiler(const VM& vm);
+
+    // Observer hooks for VM::runObserved().
+    void before(VM& vm, size_t pc, const Instruction& inst);
+    void after(VM& vm, size_t pc, const Instruction& inst);
+
+    // Close every still-open activation; call once the run has returned.
+    void finish();
+
+    // Flat profile, call graph, per-pc hits and folded stacks.
+    void report(std::ostream& out) const;
+    // Folded stacks only ("a;b;c <instructions>"), for flamegraph.pl.
+    void writeFolded(std::ostream& out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct FuncStats {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t self_instrs = 0;
+        uint64_t total_instrs = 0;
+        uint64_t self_ns = 0;
+        uint64_t total_ns = 0;
+        uint32_t active = 0; // live activations, so recursion isn't double counted
+    };
+
+    // Calling-context tree node, one per distinct call path.
+    struct StackNode {
+        size_t func;
+        size_t parent;
+        uint64_t self_instrs = 0;
+        std::unordered_map<size_t, size_t> children; // func -> node
+    };
+
+    struct Activation {
+        size_t func;
+        size_t node;
+        Clock::time_point entered;
+        uint64_t instrs_at_entry;
+        uint64_t child_ns = 0;
+    };
+
+    size_t funcFor(size_t entry_pc);
+    void enter(size_t entry_pc);
+    void leave();
+    std::string pathOf(size_t node) const;
+
+    const VM& vm_;
+    std::vector<FuncStats> funcs_;
+    std::unordered_map<size_t, size_t> func_index_;  // entry pc -> funcs_ index
+    std::unordered_map<uint64_t, uint64_t> edges_;   // caller << 32 | callee -> calls
+    std::vector<StackNode> nodes_;
+    std::vector<Activation> active_;
+    std::vector<uint64_t> pc_hits_;
+    uint64_t instrs_ = 0;
+    size_t depth_before_ = 0;
+    Clock::time_point start_;
+    Clock::duration wall_{};
+};
+
+} // namespace detvm
@@ -8,22 +8,23 @@
 
 class Reader {
 public:
-    Reader(const std::vector<uint8_t>& data) : data_(data), pos_(0) {}
+    Reader(const std::vector<uint8_t>& data) : data_(data.data()), size_(data.size()), pos_(0) {}
+    Reader(const uint8_t* data, std::size_t size) : data_(data), size_(size), pos_(0) {}
 
     template <typename T>
     T read() {
-        if (pos_ + sizeof(T) > data_.size())
+        if (pos_ + sizeof(T) > size_)
             throw std::runtime_error("Unexpected EOF while reading");
         T value;
-        std::memcpy(&value, data_.data() + pos_, sizeof(T));
+        std::memcpy(&value, data_ + pos_, sizeof(T));
         pos_ += sizeof(T);
         return value;
     }
 
     std::string readString(std::size_t len) {
-        if (pos_ + len > data_.size())
+        if (pos_ + len > size_)
             throw std::runtime_error("Unexpected EOF while reading string");
-        std::string s(reinterpret_cast<const char*>(data_.data() + pos_), len);
+        std::string s(reinterpret_cast<const char*>(data_ + pos_), len);
         pos_ += len;
         return s;
     }
@@ -34,9 +35,26 @@ public:
             throw std::runtime_error("Invalid file magic: expected " + std::string(magic) + " but got" + s + "\n");
     }
 
-    bool eof() const { return pos_ >= data_.size(); }
+    void skip(std::size_t len) {
+        if (pos_ + len > size_)
+            throw std::runtime_error("Unexpected EOF while skipping");
+        pos_ += len;
+    }
+
+    // true when the next bytes are `magic`; reads nothing
+    bool peek(const char* magic, std::size_t len) const {
+        return pos_ + len <= size_ && std::memcmp(data_ + pos_, magic, len) == 0;
+    }
+
+    // pointer to the next unread byte
+    const uint8_t* cursor() const { return data_ + pos_; }
+    std::size_t remaining() const { return size_ - pos_; }
+
+    bool eof() const { return pos_ >= size_; }
+    std::size_t pos() const { return pos_; }
 
 private:
-    const std::vector<uint8_t>& data_;
+    const uint8_t* data_;
+    std::size_t size_;
     std::size_t pos_;
 };
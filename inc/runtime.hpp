@@ -0,0 +1,51 @@
+#pragma once
+#include "detvm.hpp"
+#include "natives.hpp"
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace detvm {
+
+// Embedding API: load a linked program once, then call its functions by
+// name as often as needed. Symbols are required, so the program must not
+// have been linked with --strip.
+//
+//     detvm::Runtime rt("factorial.dvm");
+//     const auto& fact = rt.function("factorial");
+//     int32_t r = rt.call(fact, {Value(5)}).asInt();
+//
+// Host functions for CALLN are added with addNative() before the first
+// call; the builtins (fnv1a, parse_int, sqrt, map_i32, ...) are always there.
+//
+// A Runtime owns a single VM and is not thread-safe. For threads, load the
+// Program once and give each thread its own Runtime over it.
+class Runtime {
+public:
+    explicit Runtime(std::shared_ptr<const Program> program, size_t reg_count = 8);
+    explicit Runtime(const std::vector<uint8_t>& image, size_t reg_count = 8);
+    explicit Runtime(const std::string& path, size_t reg_count = 8);
+
+    // nullptr when the program has no function of that name
+    const FunctionSymbol* find(const std::string& name) const;
+    // like find(), but throws
+    const FunctionSymbol& function(const std::string& name) const;
+
+    Value call(const FunctionSymbol& fn, std::initializer_list<Value> args = {});
+    Value call(const FunctionSymbol& fn, const std::vector<Value>& args);
+    Value call(const std::string& name, std::initializer_list<Value> args = {});
+
+    void addNative(const std::string& name, NativeFn fn, uint16_t params);
+
+    VM& vm() { return vm_; }
+    const VM& vm() const { return vm_; }
+    const std::shared_ptr<const Program>& program() const { return vm_.program; }
+
+private:
+    VM vm_;
+    std::unordered_map<std::string, size_t> by_name_; // index into program()->functions
+    NativeRegistry natives_ = NativeRegistry::builtins();
+};
+
+} // namespace detvm
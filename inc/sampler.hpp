@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "detvm.hpp"
+
+namespace detvm {
+
+// Statistical profiler (detvm --sample). A SIGPROF interval timer snapshots
+// VM::pc and the return pcs of the callstack into a preallocated table of
+// distinct stacks, so nothing is added to the dispatch loop and memory stays
+// bounded however long the VM runs. Samples are only taken on the thread
+// running the VM; other threads must block SIGPROF.
+class Sampler {
+public:
+    static constexpr size_t MAX_DEPTH = 64;  // deeper stacks keep the innermost frames
+
+    explicit Sampler(const VM& vm, size_t slots = 4096);
+    ~Sampler();
+
+    // Install the handler and start the timer; false where SIGPROF sampling
+    // is unavailable (the VM then simply runs unsampled).
+    bool start(unsigned hz = 99);
+    void stop();
+
+    uint64_t samples() const { return taken_; }
+
+    // pprof-style "top" table: flat and cumulative samples per function.
+    void report(std::ostream& out) const;
+    // Folded stacks ("a;b;c <samples>"), for flamegraph.pl.
+    void writeFolded(std::ostream& out) const;
+
+private:
+    struct Slot {
+        uint64_t hash = 0;
+        uint64_t count = 0;       // 0 = free slot
+        uint32_t depth = 0;
+        uint32_t pcs[MAX_DEPTH];  // innermost (current pc) first, then call sites
+    };
+
+    static void onSignal(int);
+    void record();
+    std::vector<std::string> namesOf(const Slot& s) const; // outermost first
+
+    const VM& vm_;
+    std::vector<Slot> slots_;
+    volatile uint64_t taken_ = 0;
+    volatile uint64_t dropped_ = 0;  // table full, or callstack mid-update
+    unsigned hz_ = 0;
+    bool running_ = false;
+};
+
+} // namespace detvm
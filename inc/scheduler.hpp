@@ -0,0 +1,96 @@
+#pragma once
+#include "detvm.hpp"
+#include "thread_pool.hpp"
+#include "channel.hpp"
+#include "shared_array.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace detvm {
+
+// M:N multiplexing of VMs over a fixed ThreadPool. Every VM runs in slices
+// of `slice` instructions (VM::resume(budget)); a preempted VM goes to the
+// back of its worker's queue, and idle workers steal, so thousands of
+// programs share a few cores fairly without a thread each.
+//
+// The same machinery runs fibers: SPAWN inside a scheduled VM spawns the
+// callee as another VM here, YIELD ends the current slice early, and JOIN
+// parks the caller until the fiber returns instead of spinning on it.
+// A VM waiting on FREAD/FWRITE leaves its worker the same way and is
+// requeued by the I/O thread that completes the request. One blocked on
+// CHSEND/CHRECV is parked until any channel moves, so fibers that can
+// only wait on each other are reported as a deadlock rather than spun.
+class Scheduler {
+public:
+    explicit Scheduler(size_t threads = 0, uint64_t slice = 10000);
+
+    // Takes the VM and starts running it from its current pc (0 for a fresh
+    // one). Returns an id for vm(id), which is also its fiber id for JOIN.
+    size_t spawn(std::unique_ptr<VM> vm);
+
+    // Blocks until every spawned VM has finished, including those waiting
+    // on I/O; rethrows a VM's error,
+    // including a deadlock (every live VM waiting in JOIN or on a channel).
+    void wait();
+
+    // Every successful channel send or receive of a VM here (or of its
+    // PARMAP helpers) calls channelMoved(), which wakes the VMs parked on a
+    // channel; channelMoves() is read before trying, for VM::channel_wait.
+    uint64_t channelMoves() const { return channel_moves_.load(); }
+    void channelMoved() {
+        channel_moves_.fetch_add(1);
+        if (channel_sleepers_.load() != 0) wakeChannelWaiters();
+    }
+
+    // Copies the return value (regs[0]) of VM `id` into `out` if it has
+    // finished; false while it is still running.
+    bool result(int32_t id, Value& out);
+
+    VM& vm(size_t id);
+    // Shared by every spawned VM that does not bring its own.
+    const std::shared_ptr<ChannelTable>& channels() const { return channels_; }
+    const std::shared_ptr<SharedArrays>& shared() const { return shared_; }
+    // PARMAP inside a scheduled VM spreads its chunks over the same workers.
+    ThreadPool& pool() { return pool_; }
+    uint64_t slices() const { return slices_.load(); }
+
+private:
+    struct Entry {
+        std::unique_ptr<VM> vm;
+        bool done = false;
+        Value result;
+        std::vector<size_t> waiters; // ids parked in JOIN on this one
+    };
+
+    void schedule(size_t id, VM* vm, bool first);
+    void finish(size_t id, VM* vm);
+    void park(size_t id, VM* vm);
+    void parkOnChannel(size_t id, VM* vm, uint64_t seen);
+    void wakeChannelWaiters();
+    void checkDeadlock() const; // with m_ held
+    void awaitIo(size_t id, VM* vm);
+
+    ThreadPool pool_;
+    uint64_t slice_;
+    std::mutex m_;
+    std::deque<Entry> vms_; // deque: spawn() never moves a running VM
+    size_t live_ = 0;       // spawned and not finished
+    size_t parked_ = 0;     // of those, waiting in JOIN or on a channel
+    std::vector<size_t> channel_parked_; // ids waiting on a channel
+    // moves bumps before reading sleepers, a parking VM the other way
+    // round, so a move racing with a park always requeues the VM
+    std::atomic<uint64_t> channel_moves_{0};
+    std::atomic<size_t> channel_sleepers_{0};
+    size_t io_waiting_ = 0; // suspended on FREAD/FWRITE, not in the pool
+    uint64_t io_woken_ = 0; // completions so far, for wait()
+    std::condition_variable io_done_;
+    std::shared_ptr<ChannelTable> channels_ = std::make_shared<ChannelTable>();
+    std::shared_ptr<SharedArrays> shared_ = std::make_shared<SharedArrays>();
+    std::atomic<uint64_t> slices_{0};
+};
+
+} // namespace detvm
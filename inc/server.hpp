@@ -0,0 +1,43 @@
+#pragma once
+#include "detvm.hpp"
+#include "runtime.hpp"
+#include "thread_pool.hpp"
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace detvm {
+
+// Request server (detvm --serve): the program is loaded once and every
+// request line calls one of its functions on a pool worker's VM.
+//
+// Protocol, one request per line, answered strictly in request order:
+//   request:  <function> [arg ...]        args as for --jobs (see parseValue)
+//   answer:   out <line>                  zero or more, whatever the call PRINTed
+//             ok <value>  |  err <message>
+//
+// Clients may pipeline as many requests as they like; they are decoded in
+// batches, run in parallel and streamed back as soon as the next answer in
+// order is ready.
+class Server {
+public:
+    Server(std::shared_ptr<const Program> program, size_t threads = 0);
+
+    // Serves one connection until its input ends.
+    void serve(std::istream& in, std::ostream& out);
+
+    // Listens on a Unix domain socket and serves every client that connects.
+    // Only returns on error (POSIX only).
+    void listen(const std::string& socket_path);
+
+    std::string handle(const std::string& request);
+
+private:
+    static constexpr size_t MAX_IN_FLIGHT = 4096; // per connection
+
+    ThreadPool pool_;
+    std::vector<std::unique_ptr<Runtime>> runtimes_; // one per pool worker
+};
+
+} // namespace detvm
@@ -0,0 +1,32 @@
+#pragma once
+#include "slot_table.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace detvm {
+
+// Fixed-size int32 array that several VMs read and write at once. Unlike a
+// Value array it is never copied: every VM holding its id sees the same
+// memory, and all access goes through atomics (ALOAD/ASTORE/AFETCHADD/ACAS).
+class SharedArray {
+public:
+    explicit SharedArray(size_t size);
+
+    size_t size() const { return size_; }
+    std::atomic<int32_t>& at(int32_t index); // throws when out of range
+
+private:
+    std::unique_ptr<std::atomic<int32_t>[]> data_;
+    size_t size_;
+};
+
+// Shared arrays visible to a group of VMs, by id (SHNEW).
+class SharedArrays : public SlotTable<SharedArray> {
+public:
+    SharedArrays() : SlotTable("shared array") {}
+    int32_t create(size_t size) { return add(std::make_unique<SharedArray>(size)); }
+};
+
+} // namespace detvm
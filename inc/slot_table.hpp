@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace detvm {
+
+// Objects shared between VMs (channels, shared arrays) by small int id.
+// Ids are handed out once and never reused; lookups take no lock, so the
+// ops using them only pay for the object's own synchronisation.
+template <typename T>
+class SlotTable {
+public:
+    explicit SlotTable(const char* what, size_t max_slots = 4096)
+        : what_(what), slots_(std::make_unique<std::atomic<T*>[]>(max_slots)), max_(max_slots) {
+        for (size_t i = 0; i < max_; ++i) slots_[i].store(nullptr, std::memory_order_relaxed);
+    }
+    ~SlotTable() {
+        for (size_t i = 0; i < max_; ++i) delete slots_[i].load(std::memory_order_relaxed);
+    }
+
+    SlotTable(const SlotTable&) = delete;
+    SlotTable& operator=(const SlotTable&) = delete;
+
+    int32_t add(std::unique_ptr<T> item) {
+        const size_t id = count_.fetch_add(1, std::memory_order_relaxed);
+        if (id >= max_) throw std::runtime_error(std::string("too many ") + what_ + "s (max " + std::to_string(max_) + ")");
+        slots_[id].store(item.release(), std::memory_order_release);
+        return static_cast<int32_t>(id);
+    }
+
+    T& at(int32_t id) const { // throws for an unknown id
+        T* p = id >= 0 && static_cast<size_t>(id) < max_ ? slots_[id].load(std::memory_order_acquire) : nullptr;
+        if (!p) throw std::runtime_error(std::string("no ") + what_ + " " + std::to_string(id));
+        return *p;
+    }
+
+private:
+    const char* what_;
+    std::unique_ptr<std::atomic<T*>[]> slots_;
+    size_t max_;
+    std::atomic<size_t> count_{0};
+};
+
+} // namespace detvm
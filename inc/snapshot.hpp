@@ -0,0 +1,19 @@
+#pragma once
+#include "detvm.hpp"
+#include <string>
+
+namespace detvm {
+
+// VM snapshots (detvm --snapshot-out / --snapshot-in): the decoded program
+// plus the whole execution state (registers, params, frames and everything
+// they own), taken when a run stops at CHECKPOINT. Restoring one resumes
+// right after that instruction, without reloading or re-initializing.
+//
+// Layout: "DTSN", u32 version, u64 text offset, u64 text count, then the
+// POOL, SYMS and STATE sections. The instructions are stored as raw
+// Instruction records at the 8-byte aligned text offset, so restoring them
+// is a single copy out of the mapped file.
+void writeSnapshot(const VM& vm, const std::string& path);
+void restoreSnapshot(VM& vm, const std::string& path);
+
+} // namespace detvm
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detvm {
+
+// Fixed-size work-stealing pool. Every worker owns a deque: it pushes and
+// pops its own work at the back and, when that runs dry, steals from the
+// front of the others. Tasks submitted from outside the pool are dealt out
+// round-robin.
+//
+// worker() tells a task which worker runs it, so callers can keep one piece
+// of per-thread state (a VM, say) per worker instead of locking. Workers
+// block SIGPROF, as the Sampler (sampler.hpp) requires.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 0); // 0: one per hardware thread
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Like submit(), but a worker queues the task behind everything already
+    // waiting on it rather than running it next: round-robin for tasks that
+    // keep rescheduling themselves.
+    void requeue(std::function<void()> task);
+
+    // Blocks until every submitted task has finished, then rethrows the first
+    // exception a task let escape, if any.
+    void wait();
+
+    size_t size() const { return workers_.size(); }
+
+    // Index of the calling worker in [0, size()), or -1 off the pool.
+    static int worker();
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void push(std::function<void()> task, bool front);
+    void loop(size_t self);
+    bool pop(size_t self, std::function<void()>& out);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex m_;
+    std::condition_variable wake_; // work arrived, or stopping
+    std::condition_variable idle_; // pending_ hit zero
+    std::atomic<size_t> queued_{0};  // submitted, not yet picked up
+    std::atomic<size_t> pending_{0}; // submitted, not yet finished
+    std::atomic<size_t> next_{0};    // round-robin cursor for outside submits
+    std::exception_ptr error_;
+    bool stop_ = false;
+};
+
+} // namespace detvm
@@ -3,8 +3,12 @@
 #include "linker.hpp"
 
 namespace detvm::Writer {
-    void writeObject(const std::string& path, const assembler::AssemblerResult& result);
+    // compress stores the file in an lz container (lz.hpp), which every
+    // reader unpacks as it goes
+    void writeObject(const std::string& path, const assembler::AssemblerResult& result, bool compress = false);
 
-    void writeProgramBinary(const std::string& path, const assembler::AssemblerResult& result);
+    // with_symbols appends the optional SYMS section (functions and labels)
+    void writeProgramBinary(const std::string& path, const assembler::AssemblerResult& result,
+                            bool with_symbols = true, bool compress = false);
 
 }
\ No newline at end of file
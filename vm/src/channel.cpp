@@ -0,0 +1,67 @@
+#include "channel.hpp"
+#include <stdexcept>
+#include <string>
+
+namespace detvm {
+
+Channel::Channel(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) n <<= 1;
+    cells_ = std::make_unique<Cell[]>(n);
+    mask_ = n - 1;
+    for (size_t i = 0; i < n; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+}
+
+// A cell is free for the push at position p when seq == p, and holds the
+// value for the pop at p when seq == p + 1; the pop hands it back for the
+// next lap by setting seq to p + capacity.
+bool Channel::push(Value& v) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+    cell->value = std::move(v);
+    v = Value();
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool Channel::pop(Value& out) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+    out = std::move(cell->value);
+    cell->value = Value();
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+// === ChannelTable ===
+
+int32_t ChannelTable::create(size_t capacity) {
+    if (capacity == 0) throw std::runtime_error("channel capacity must be at least 1");
+    return add(std::make_unique<Channel>(capacity));
+}
+
+} // namespace detvm
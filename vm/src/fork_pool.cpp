@@ -0,0 +1,44 @@
+#include "fork_pool.hpp"
+
+namespace detvm {
+
+ForkPool::ForkPool(const VM& parent, size_t capacity)
+    : template_(parent.fork()), capacity_(capacity) {
+    // a parent stopped at CHECKPOINT hands its clones the resume point
+    if (template_.checkpointed) template_.pc = template_.checkpoint_pc;
+    template_.stop_at_checkpoint = false;
+    template_.checkpointed = false;
+    refill();
+}
+
+std::unique_ptr<VM> ForkPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (!ready_.empty()) {
+            auto vm = std::move(ready_.back());
+            ready_.pop_back();
+            return vm;
+        }
+    }
+    // the template is only ever read, so forking needs no lock
+    return std::make_unique<VM>(template_.fork());
+}
+
+void ForkPool::refill() {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if (ready_.size() >= capacity_) return;
+        }
+        auto vm = std::make_unique<VM>(template_.fork());
+        std::lock_guard<std::mutex> lock(m_);
+        ready_.push_back(std::move(vm));
+    }
+}
+
+size_t ForkPool::available() const {
+    std::lock_guard<std::mutex> lock(m_);
+    return ready_.size();
+}
+
+} // namespace detvm
@@ -0,0 +1,140 @@
+#include "fuel.hpp"
+#include <sstream>
+
+namespace detvm {
+
+FuelSchedule FuelSchedule::parse(std::istream& in) {
+    FuelSchedule s;
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        line = line.substr(0, line.find(';'));
+        std::istringstream ls(line);
+        std::string name;
+        int64_t cost;
+        if (!(ls >> name)) continue;
+        if (!(ls >> cost) || cost < 0 || cost > UINT32_MAX)
+            throw std::runtime_error("fuel costs line " + std::to_string(line_no) + ": expected <name> <cost>");
+
+        if (name == "per_element") {
+            s.per_element = static_cast<uint32_t>(cost);
+            continue;
+        }
+        bool found = false;
+        for (size_t op = 0; op < s.cost.size(); ++op) {
+            if (name == opcodeName(static_cast<Opcode>(op))) {
+                s.cost[op] = static_cast<uint32_t>(cost);
+                found = true;
+                break;
+            }
+        }
+        if (!found) throw std::runtime_error("fuel costs line " + std::to_string(line_no) + ": unknown opcode " + name);
+    }
+    return s;
+}
+
+// Instructions after which control may not simply fall through to pc + 1.
+static bool endsBlock(Opcode op) {
+    switch (op) {
+        case Opcode::JMP: case Opcode::JZ:  case Opcode::JNZ:  case Opcode::JL:  case Opcode::JG:
+        case Opcode::JLZ: case Opcode::JLNZ: case Opcode::JLL: case Opcode::JLG:
+        case Opcode::CALL: case Opcode::RET: case Opcode::ENTER: case Opcode::LEAVE:
+        case Opcode::HALT: case Opcode::CHECKPOINT: case Opcode::YIELD: case Opcode::JOIN:
+        case Opcode::CHSEND: case Opcode::CHRECV: case Opcode::FREAD: case Opcode::FWRITE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static size_t jumpTarget(const Instruction& inst) {
+    switch (inst.opcode) {
+        case Opcode::JMP: case Opcode::CALL:
+            return inst.a;
+        case Opcode::JZ:  case Opcode::JNZ:  case Opcode::JL:  case Opcode::JG:
+        case Opcode::JLZ: case Opcode::JLNZ: case Opcode::JLL: case Opcode::JLG:
+            return inst.b;
+        default:
+            return SIZE_MAX;
+    }
+}
+
+FuelTable FuelTable::build(const Program& program, const FuelSchedule& schedule) {
+    const auto& code = program.code;
+    const size_t n = code.size();
+
+    // === leaders: jump targets and whatever follows a block end ===
+    std::vector<bool> leader(n + 1, false);
+    leader[0] = true;
+    leader[n] = true;
+    for (size_t pc = 0; pc < n; ++pc) {
+        if (!endsBlock(code[pc].opcode)) continue;
+        leader[pc + 1] = true;
+        size_t t = jumpTarget(code[pc]);
+        if (t < n) leader[t] = true;
+    }
+    for (const auto& fn : program.functions)
+        if (fn.pc_start < n) leader[fn.pc_start] = true;
+
+    // === walk backwards, summing the rest of each block ===
+    FuelTable t;
+    t.block_end.resize(n);
+    t.cost.resize(n);
+    t.per_element = schedule.per_element;
+    for (size_t pc = n; pc-- > 0;) {
+        const int64_t own = schedule.cost[static_cast<uint16_t>(code[pc].opcode) & 0xFF];
+        if (leader[pc + 1] || endsBlock(code[pc].opcode)) {
+            t.block_end[pc] = static_cast<uint32_t>(pc + 1);
+            t.cost[pc] = own;
+        } else {
+            t.block_end[pc] = t.block_end[pc + 1];
+            t.cost[pc] = own + t.cost[pc + 1];
+        }
+    }
+    return t;
+}
+
+// Runs until pc leaves the code; false when it stopped short because the
+// next block costs more fuel than is left.
+bool VM::runBlocks(const FuelTable& table, bool prepaid) {
+    const Code& code = program->code;
+    while (pc < code.size()) {
+        // a block is paid for up front, so a trap never splits one
+        const int64_t block = prepaid ? 0 : table.cost[pc];
+        prepaid = false;
+        if (fuel < block) return false;
+        fuel -= block;
+        for (size_t left = table.block_end[pc] - pc; left > 0 && pc < code.size(); --left)
+            dispatch(code[pc]);
+    }
+    return true;
+}
+
+RunStatus VM::resumeMetered(const FuelTable& table) {
+    if (!program) throw std::runtime_error("no program loaded");
+    if (table.cost.size() != program->code.size())
+        throw std::runtime_error("fuel table was built for a different program");
+    // a channel op or FREAD/FWRITE that suspended was paid for when it first ran
+    bool prepaid = false;
+    if (preempted_) {
+        pc = preempt_pc_;
+        preempted_ = false;
+        prepaid = rerun_paid_;
+    }
+    rerun_paid_ = false;
+    budget_ = INT64_MAX;
+    segment_ = pc;
+    element_cost_ = table.per_element;
+    metered_ = &table;
+
+    RunStatus status = runBlocks(table, prepaid) ? RunStatus::Finished : RunStatus::OutOfFuel;
+
+    element_cost_ = 0;
+    metered_ = nullptr;
+    if (status == RunStatus::Finished && preempted_)
+        status = io_ticket >= 0 ? RunStatus::Pending : RunStatus::Preempted;
+    return status;
+}
+
+} // namespace detvm
@@ -0,0 +1,144 @@
+#include "io_service.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace detvm {
+
+IoService::IoService(size_t threads) : pool_(threads ? threads : 1) {}
+
+const std::shared_ptr<IoService>& IoService::global() {
+    static const std::shared_ptr<IoService> io = std::make_shared<IoService>();
+    return io;
+}
+
+int64_t IoService::read(const std::string& path) {
+    return submit([path] {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) throw std::runtime_error("FREAD: cannot open " + path);
+        std::ostringstream data;
+        data << in.rdbuf();
+        if (in.bad()) throw std::runtime_error("FREAD: error reading " + path);
+        return Value(data.str());
+    });
+}
+
+int64_t IoService::write(const std::string& path, std::string data) {
+    return submit([path, data = std::move(data)] {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("FWRITE: cannot open " + path);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        out.flush();
+        if (!out) throw std::runtime_error("FWRITE: error writing " + path);
+        return Value(static_cast<int32_t>(data.size()));
+    });
+}
+
+int64_t IoService::submit(std::function<Value()> work) {
+    int64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        ticket = next_++;
+        requests_.emplace(ticket, Request{});
+    }
+    pool_.submit([this, ticket, work = std::move(work)] {
+        Value result;
+        std::string error;
+        try {
+            result = work();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        std::function<void()> then;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            Request& r = requests_.at(ticket);
+            r.done = true;
+            r.result = std::move(result);
+            r.error = std::move(error);
+            then.swap(r.then);
+        }
+        done_.notify_all();
+        if (then) then();
+    });
+    return ticket;
+}
+
+bool IoService::take(int64_t ticket, Value& out) {
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        auto it = requests_.find(ticket);
+        if (it == requests_.end()) throw std::runtime_error("no I/O request " + std::to_string(ticket));
+        if (!it->second.done) return false;
+        out = std::move(it->second.result);
+        error = std::move(it->second.error);
+        requests_.erase(it);
+    }
+    if (!error.empty()) throw std::runtime_error(error);
+    return true;
+}
+
+void IoService::wait(int64_t ticket) {
+    std::unique_lock<std::mutex> lock(m_);
+    done_.wait(lock, [&] {
+        auto it = requests_.find(ticket);
+        return it == requests_.end() || it->second.done;
+    });
+}
+
+void IoService::whenDone(int64_t ticket, std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        auto it = requests_.find(ticket);
+        if (it != requests_.end() && !it->second.done) {
+            it->second.then = std::move(fn);
+            return;
+        }
+    }
+    fn();
+}
+
+// === IoLoop ===
+
+size_t IoLoop::add(std::unique_ptr<VM> vm) {
+    vms_.push_back(std::move(vm));
+    ready_.push_back(vms_.size() - 1);
+    return vms_.size() - 1;
+}
+
+void IoLoop::run() {
+    while (!ready_.empty() || waiting_) {
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            // nothing to run: sleep until some request completes
+            if (ready_.empty()) wake_.wait(lock, [&] { return !completed_.empty(); });
+            for (size_t id : completed_) ready_.push_back(id);
+            waiting_ -= completed_.size();
+            completed_.clear();
+        }
+        if (ready_.empty()) continue;
+
+        const size_t id = ready_.front();
+        ready_.pop_front();
+        VM& vm = *vms_[id];
+        ++slices_;
+        switch (vm.resume(slice_)) {
+            case RunStatus::Finished:
+                break;
+            case RunStatus::Pending:
+                ++waiting_;
+                vm.io->whenDone(vm.io_ticket, [this, id] {
+                    std::lock_guard<std::mutex> lock(m_); // run() may return as soon as it sees id
+                    completed_.push_back(id);
+                    wake_.notify_one();
+                });
+                break;
+            default:
+                ready_.push_back(id);
+                break;
+        }
+    }
+}
+
+} // namespace detvm
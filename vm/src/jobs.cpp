@@ -0,0 +1,65 @@
+#include "jobs.hpp"
+#include "runtime.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <sstream>
+
+namespace detvm {
+
+Value parseValue(const std::string& token) {
+    if (token == "true") return Value(true);
+    if (token == "false") return Value(false);
+
+    try {
+        size_t used = 0;
+        long v = std::stol(token, &used);
+        if (used == token.size() && v >= INT32_MIN && v <= INT32_MAX) return Value(static_cast<int32_t>(v));
+        double d = std::stod(token, &used);
+        if (used == token.size()) return Value(d);
+    } catch (const std::exception&) {
+        // not a number
+    }
+    return Value(token);
+}
+
+std::vector<Value> parseArgs(const std::string& line) {
+    std::vector<Value> args;
+    std::istringstream in(line);
+    std::string token;
+    while (in >> token) args.push_back(parseValue(token));
+    return args;
+}
+
+size_t runJobs(std::shared_ptr<const Program> program, const JobOptions& opt,
+               const std::vector<std::string>& inputs, std::ostream& out) {
+    ThreadPool pool(opt.threads);
+
+    // one VM per worker, all over the same program
+    std::vector<std::unique_ptr<Runtime>> runtimes;
+    for (size_t w = 0; w < pool.size(); ++w) runtimes.push_back(std::make_unique<Runtime>(program));
+    const FunctionSymbol& entry = runtimes[0]->function(opt.entry);
+
+    std::vector<std::string> results(inputs.size());
+    std::atomic<size_t> failed{0};
+
+    for (size_t n = 0; n < inputs.size(); ++n) {
+        pool.submit([&, n] {
+            Runtime& rt = *runtimes[ThreadPool::worker()];
+            std::ostringstream captured;
+            rt.vm().out = &captured;
+            try {
+                captured << rt.call(entry, parseArgs(inputs[n])).str() << "\n";
+            } catch (const std::exception& e) {
+                captured << "error: " << e.what() << "\n";
+                failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            results[n] = captured.str();
+        });
+    }
+    pool.wait();
+
+    for (const auto& r : results) out << r;
+    return failed.load();
+}
+
+} // namespace detvm
@@ -1,65 +1,341 @@
     #include <iostream>
     #include "detvm.hpp"
     #include "constant_pool.hpp"
+    #include "dvm_format.hpp"
+#include "lz.hpp"
+    #include "mapped_file.hpp"
+    #include <algorithm>
     #include <fstream>
+    #include <mutex>
 
     namespace detvm {
 
-    void VM::loadProgram(const std::vector<uint8_t>& data) {
-        Reader r(data);
+    // What a lazily loaded Program still needs from its image (map() keeps
+    // the image alive through Program::image).
+    struct LazyImage {
+        std::mutex m;
+        const uint8_t* pool = nullptr; // POOL section
+        size_t pool_size = 0;
+        const uint8_t* cidx = nullptr; // u64 offset into POOL of each constant
+        std::vector<dvm::FunctionEntry> functions;
+        std::vector<uint8_t> verified; // per function, under m
+        std::vector<uint8_t> decoded;  // per constant, under m
+        std::unique_ptr<std::atomic<uint8_t>[]> entered; // Program::entered_
+    };
+
+    static Value readConstant(Reader& r) {
+        ConstType type = r.read<ConstType>();
+        size_t size = r.read<size_t>();
+
+        switch (type) {
+            case ConstType::INT: // example: integer
+                return Value(r.read<int32_t>());
+            case ConstType::STRING: // string
+                return Value(r.readString(size));
+            case ConstType::FLOAT: // the assembler writes every float literal as DOUBLE
+            case ConstType::DOUBLE:
+                return Value(r.read<double>());
+            case ConstType::CHAR: // example: char
+                return Value(r.read<char>());
+        }
+        throw std::runtime_error("unknown constant type " + std::to_string(static_cast<int>(type)));
+    }
+
+    static void readSymbols(Reader& r, Program& prog) {
+        uint32_t func_count = r.read<uint32_t>();
+        prog.functions.reserve(func_count);
+        for (uint32_t i = 0; i < func_count; ++i) {
+            FunctionSymbol fn;
+            fn.name = r.readString(r.read<uint32_t>());
+            fn.pc_start = r.read<uint32_t>();
+            fn.pc_end = r.read<uint32_t>();
+            fn.params = r.read<uint16_t>();
+            fn.locals = r.read<uint16_t>();
+            prog.functions.push_back(std::move(fn));
+        }
+
+        uint32_t label_count = r.read<uint32_t>();
+        prog.labels.reserve(label_count);
+        for (uint32_t i = 0; i < label_count; ++i) {
+            LabelSymbol l;
+            l.name = r.readString(r.read<uint32_t>());
+            l.pc = r.read<uint32_t>();
+            prog.labels.push_back(std::move(l));
+        }
+    }
+
+    // === version 3: section directory ===
+
+    // Decodes the constants LOADC/LOADCL use in [begin, end) that are not there yet.
+    static void decodeConstants(LazyImage& z, const Program& prog, size_t begin, size_t end) {
+        for (size_t pc = begin; pc < end; ++pc) {
+            const Instruction& inst = prog.code[pc];
+            if (inst.opcode != Opcode::LOADC && inst.opcode != Opcode::LOADCL) continue;
+            size_t k = inst.b;
+            if (k >= z.decoded.size() || z.decoded[k]) continue;
+
+            uint64_t offset;
+            std::memcpy(&offset, z.cidx + k * sizeof(offset), sizeof(offset));
+            if (offset > z.pool_size) throw std::runtime_error("corrupt .dvm: constant " + std::to_string(k) + " outside POOL");
+            Reader r(z.pool + offset, z.pool_size - offset);
+            prog.constant_pool[k] = readConstant(r);
+            z.decoded[k] = 1;
+        }
+    }
+
+    static void parseSections(const uint8_t* data, size_t size, Reader& r, Program& prog,
+                              bool with_symbols, bool in_place) {
+        r.expect("SDIR", 4);
+        uint32_t count = r.read<uint32_t>();
+        std::vector<dvm::Section> dir;
+        for (uint32_t i = 0; i < count; ++i) {
+            dvm::Section s = r.read<dvm::Section>();
+            if (s.offset > size || s.size > size - s.offset)
+                throw std::runtime_error("corrupt .dvm: section " + std::string(s.tag, 4) + " runs past the end of the file");
+            dir.push_back(s);
+        }
+
+        auto find = [&](const char* tag) -> const dvm::Section* {
+            for (const auto& s : dir)
+                if (std::memcmp(s.tag, tag, 4) == 0) return &s;
+            return nullptr;
+        };
+        auto require = [&](const char* tag) -> const dvm::Section& {
+            const dvm::Section* s = find(tag);
+            if (!s) throw std::runtime_error(std::string("corrupt .dvm: no ") + tag + " section");
+            return *s;
+        };
+        auto verify = [&](const dvm::Section& s) {
+            if (dvm::checksum(data + s.offset, s.size) != s.checksum)
+                throw std::runtime_error("corrupt .dvm: " + std::string(s.tag, 4) + " fails its checksum");
+        };
+        auto reader = [&](const dvm::Section& s) { return Reader(data + s.offset, s.size); };
+
+        // === TEXT, in place when possible ===
+        const dvm::Section& text = require("TEXT");
+        if (text.size % sizeof(Instruction)) throw std::runtime_error("corrupt .dvm: TEXT is not whole instructions");
+        const size_t text_size = text.size / sizeof(Instruction);
+        const auto* code = reinterpret_cast<const Instruction*>(data + text.offset);
+        if (in_place && reinterpret_cast<uintptr_t>(code) % alignof(Instruction) == 0) {
+            prog.code.view(code, text_size);
+        } else {
+            std::vector<Instruction> copy(text_size);
+            std::memcpy(copy.data(), code, text.size);
+            prog.code.assign(std::move(copy));
+        }
+
+        // === FIDX ===
+        const dvm::Section& fidx = require("FIDX");
+        verify(fidx);
+        Reader fr = reader(fidx);
+        std::vector<dvm::FunctionEntry> functions(fr.read<uint32_t>());
+        for (auto& fn : functions) {
+            fn = fr.read<dvm::FunctionEntry>();
+            if (fn.pc_start > fn.pc_end || fn.pc_end > text_size)
+                throw std::runtime_error("corrupt .dvm: FIDX entry outside TEXT");
+        }
+
+        // === NATV (only when the program uses CALLN) ===
+        if (const dvm::Section* natv = find("NATV")) {
+            verify(*natv);
+            Reader nr = reader(*natv);
+            uint32_t native_count = nr.read<uint32_t>();
+            prog.natives.reserve(native_count);
+            for (uint32_t i = 0; i < native_count; ++i)
+                prog.natives.push_back(nr.readString(nr.read<uint32_t>()));
+        }
+
+        // === SYMS (optional, decoded only on request) ===
+        if (const dvm::Section* syms = find("SYMS"); syms && with_symbols) {
+            verify(*syms);
+            Reader sr = reader(*syms);
+            readSymbols(sr, prog);
+        }
+
+        // === POOL ===
+        const dvm::Section& pool = require("POOL");
+        const dvm::Section& cidx = require("CIDX");
+        Reader pr = reader(pool);
+        const size_t pool_size = pr.read<size_t>();
+        if (cidx.size != pool_size * sizeof(uint64_t)) throw std::runtime_error("corrupt .dvm: CIDX does not match POOL");
+
+        if (!in_place) {
+            // read in full anyway: check everything and decode every constant
+            verify(text);
+            verify(pool);
+            prog.constant_pool.reserve(pool_size);
+            for (size_t i = 0; i < pool_size; ++i) prog.constant_pool.push_back(readConstant(pr));
+            return;
+        }
+
+        // Lazy: functions are checked and get their constants in enter();
+        // the code outside every function runs first, so it is checked and
+        // gets them now. Without ENTR only the whole of TEXT can vouch for it.
+        verify(cidx);
+        if (const dvm::Section* entr = find("ENTR")) {
+            verify(*entr);
+            Reader er = reader(*entr);
+            if (er.read<uint32_t>() != dvm::entryChecksum(prog.code.data(), text_size, functions))
+                throw std::runtime_error("corrupt .dvm: the code outside every function fails its checksum");
+        } else {
+            verify(text);
+        }
+        auto z = std::make_shared<LazyImage>();
+        z->pool = data + pool.offset;
+        z->pool_size = pool.size;
+        z->cidx = data + cidx.offset;
+        z->functions = std::move(functions);
+        z->verified.assign(z->functions.size(), 0);
+        z->decoded.assign(pool_size, 0);
+        z->entered = std::make_unique<std::atomic<uint8_t>[]>(text_size);
+        prog.constant_pool.resize(pool_size);
+
+        size_t pc = 0;
+        for (const auto& fn : z->functions) {
+            if (fn.pc_start > pc) decodeConstants(*z, prog, pc, fn.pc_start);
+            pc = std::max<size_t>(pc, fn.pc_end);
+        }
+        decodeConstants(*z, prog, pc, text_size);
+
+        if (text_size) prog.entered_ = z->entered.get();
+        prog.lazy_ = std::move(z);
+    }
+
+    void Program::materialize(size_t pc) const {
+        LazyImage& z = *lazy_;
+        std::lock_guard<std::mutex> lock(z.m);
+        if (entered_[pc].load(std::memory_order_relaxed)) return;
+
+        // the function starting at pc, or else the one containing it
+        auto it = std::upper_bound(z.functions.begin(), z.functions.end(), pc,
+                                   [](size_t at, const dvm::FunctionEntry& fn) { return at < fn.pc_start; });
+        if (it != z.functions.begin() && pc < (--it)->pc_end) {
+            const size_t idx = static_cast<size_t>(it - z.functions.begin());
+            if (!z.verified[idx]) {
+                if (dvm::checksum(&code[it->pc_start], (it->pc_end - it->pc_start) * sizeof(Instruction)) != it->checksum)
+                    throw std::runtime_error("corrupt .dvm: function at pc " + std::to_string(it->pc_start) +
+                                             " fails its checksum");
+                decodeConstants(z, *this, it->pc_start, it->pc_end);
+                z.verified[idx] = 1;
+            }
+        }
+        entered_[pc].store(1, std::memory_order_release);
+    }
+
+    void Program::materializeAll() const {
+        if (!lazy_) return;
+        for (const auto& fn : lazy_->functions) enter(fn.pc_start);
+    }
+
+    // With in_place, the TEXT of a version 2 or 3 image becomes a view into
+    // `data`, and a version 3 pool is decoded lazily from it; either way the
+    // caller then has to keep `data` alive.
+    static std::shared_ptr<Program> parse(const uint8_t* data, size_t size, bool with_symbols, bool in_place) {
+        auto prog = std::make_shared<Program>();
+        auto& constant_pool = prog->constant_pool;
+        Reader r(data, size);
 
         r.expect("DTVM", 4);
 
         uint64_t version = r.read<uint64_t>();
-        if (version > CURRENT_VM_VERSION)
+        if (version > Program::CURRENT_VERSION)
             throw std::runtime_error("Unsupported VM version");
 
+        if (version >= 3) {
+            parseSections(data, size, r, *prog, with_symbols, in_place);
+            return prog;
+        }
+
         r.expect("POOL", 4);
         size_t pool_size = r.read<size_t>();
 
-        for (size_t i = 0; i < pool_size; ++i) {
-            ConstType type = r.read<ConstType>();
-            size_t size = r.read<size_t>();
-
-            switch (type) {
-                case ConstType::INT: { // example: integer
-                    int32_t val = r.read<int32_t>();
-                    constant_pool.push_back(Value(val));
-                    break;
-                }
-                case ConstType::STRING: { // string
-                    std::string s = r.readString(size);
-                    constant_pool.push_back(Value(s));
-                    break;
-                }
-                case ConstType::FLOAT: { // example: float
-                    double val = r.read<double>();
-                    constant_pool.push_back(Value(val));
-                    break;
-                }
-                case ConstType::CHAR: { // example: char
-                    char val = r.read<char>();
-                    constant_pool.push_back(Value(val));
-                    break;
-                }
-                
-            }
-        }
+        for (size_t i = 0; i < pool_size; ++i) constant_pool.push_back(readConstant(r));
 
         r.expect("TEXT", 4);
         size_t text_size = r.read<size_t>();
-        code.reserve(text_size);
 
-        for (size_t i = 0; i < text_size; ++i) {
-            Opcode opcode = r.read<Opcode>();
-            uint16_t a = r.read<uint16_t>();
-            uint16_t b = r.read<uint16_t>();
-            uint16_t c = r.read<uint16_t>();
-            code.push_back(Instruction{opcode, a, b, c});
+        if (version >= 2) {
+            // padded up to TEXT_ALIGN, then the instructions exactly as in memory
+            r.skip((Program::TEXT_ALIGN - r.pos() % Program::TEXT_ALIGN) % Program::TEXT_ALIGN);
+            if (text_size > r.remaining() / sizeof(Instruction))
+                throw std::runtime_error("Unexpected EOF while reading TEXT");
+            const auto* text = reinterpret_cast<const Instruction*>(r.cursor());
+            if (in_place && reinterpret_cast<uintptr_t>(text) % alignof(Instruction) == 0) {
+                prog->code.view(text, text_size);
+            } else {
+                std::vector<Instruction> code(text_size);
+                std::memcpy(code.data(), r.cursor(), text_size * sizeof(Instruction));
+                prog->code.assign(std::move(code));
+            }
+            r.skip(text_size * sizeof(Instruction));
+        } else {
+            std::vector<Instruction> code;
+            code.reserve(text_size);
+            for (size_t i = 0; i < text_size; ++i) {
+                Opcode opcode = r.read<Opcode>();
+                uint16_t a = r.read<uint16_t>();
+                uint16_t b = r.read<uint16_t>();
+                uint16_t c = r.read<uint16_t>();
+                code.push_back(Instruction{opcode, a, b, c});
+            }
+            prog->code.assign(std::move(code));
+        }
+
+        // === NATV (only when the program uses CALLN) ===
+        if (r.peek("NATV", 4)) {
+            r.skip(4);
+            uint32_t native_count = r.read<uint32_t>();
+            prog->natives.reserve(native_count);
+            for (uint32_t i = 0; i < native_count; ++i)
+                prog->natives.push_back(r.readString(r.read<uint32_t>()));
+        }
+
+        // === SYMS (optional) ===
+        // Only the profilers and debugging tools need symbols, so a plain run
+        // jumps over the section without decoding it.
+        if (!r.eof()) {
+            r.expect("SYMS", 4);
+            size_t sect_size = r.read<size_t>();
+
+            if (!with_symbols) {
+                r.skip(sect_size);
+            } else {
+                readSymbols(r, *prog);
+            }
         }
 
         if (!r.eof())
             std::cerr << "[warn] trailing bytes at end of file\n";
+
+        return prog;
+    }
+
+    std::shared_ptr<const Program> Program::load(const std::vector<uint8_t>& data, bool with_symbols) {
+        if (lz::isCompressed(data.data(), data.size())) {
+            auto unpacked = lz::decompress(data.data(), data.size());
+            return parse(unpacked.data(), unpacked.size(), with_symbols, false);
+        }
+        return parse(data.data(), data.size(), with_symbols, false);
+    }
+
+    std::shared_ptr<const Program> Program::map(const std::string& path, bool with_symbols) {
+        auto file = std::make_shared<const MappedFile>(path);
+        // a compressed file is unpacked whole, not streamed, and the copy used
+        // as the mapping: the parser and lazy loading need random access
+        if (lz::isCompressed(file->data(), file->size()))
+            file = std::make_shared<const MappedFile>(lz::decompress(file->data(), file->size()));
+        auto prog = parse(file->data(), file->size(), with_symbols, true);
+        const auto* text = reinterpret_cast<const uint8_t*>(prog->code.data());
+        if (prog->lazy_ || (text >= file->data() && text < file->data() + file->size())) prog->image = std::move(file);
+        return prog;
+    }
+
+    void VM::loadProgram(const std::vector<uint8_t>& data) {
+        program = Program::load(data, load_symbols);
+    }
+
+    void VM::loadProgram(const std::string& path) {
+        program = Program::map(path, load_symbols);
     }
 
     }
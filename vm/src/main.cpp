@@ -1,28 +1,391 @@
 #include "detvm.hpp"
 #include "ops.hpp"
+#include "profile.hpp"
+#include "sampler.hpp"
+#include "opstats.hpp"
+#include "perf_counters.hpp"
+#include "observed_run.hpp"
+#include "jobs.hpp"
+#include "snapshot.hpp"
+#include "server.hpp"
+#include "scheduler.hpp"
+#include "fuel.hpp"
+#include "io_service.hpp"
+#include <algorithm>
+#include <sstream>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
-int main(int argc, char** argv) {
+static void usage() {
+    std::cerr << "Usage: vm [options] <input.detbc>\n"
+              << "       vm [options] --snapshot-in <file>\n"
+              << "  --profile[=<file>]   instrumented function profile (default: stderr)\n"
+              << "  --sample[=<hz>]      statistical SIGPROF profile (default 99 Hz, stderr)\n"
+              << "  --folded <file>      write folded stacks for flame graphs\n"
+              << "  --opstats[=<file>]   opcode / n-gram / branch statistics as JSON (default: stderr)\n"
+              << "  --perf-counters[=<n>] hardware counters around the run, optionally per n-instruction window\n"
+              << "  --jobs <n>           call the entry function once per input line on n threads\n"
+              << "  --entry <name>       entry function for --jobs (default: main)\n"
+              << "  --inputs <file>      input lines for --jobs (default: stdin)\n"
+              << "  --serve <socket|->   answer \"<function> args...\" request lines on a Unix socket or stdin\n"
+              << "  --instances <n>      run n copies of the program multiplexed over --threads\n"
+              << "  --event-loop         run the --instances on this thread alone, overlapping their FREAD/FWRITE\n"
+              << "  --slice <n>          instructions per time slice for --instances and fibers (default 10000)\n"
+              << "  --threads <n>        worker threads for --serve / --instances / fibers (default: one per core)\n"
+              << "  --fuel <n>           meter the run; stop with exit code 2 once n units are spent\n"
+              << "  --fuel-costs <file>  per-opcode costs for --fuel (\"<MNEMONIC> <cost>\" lines)\n"
+              << "  --snapshot-out <file> run until CHECKPOINT, then save the whole VM state and exit\n"
+              << "  --snapshot-in <file> resume a saved snapshot instead of loading a program\n";
+}
+
+int main(int argc, char** argv) try {
     using namespace detvm;
 
-    if (argc < 2) {
-        std::cerr << "Usage: vm <input.detbc>\n";
+    std::string filename;
+    bool profile = false;
+    std::string profile_out;
+    std::string folded_out;
+    unsigned sample_hz = 0;
+    bool opstats = false;
+    std::string opstats_out;
+    bool perf = false;
+    size_t perf_window = 0;
+    bool jobs = false;
+    JobOptions job_opt;
+    std::string inputs_path;
+    std::string snapshot_out;
+    std::string snapshot_in;
+    std::string serve_on;
+    size_t threads = 0;
+    size_t instances = 0;
+    bool event_loop = false;
+    uint64_t slice = 10000;
+    int64_t fuel = -1;
+    std::string fuel_costs;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--profile") {
+            profile = true;
+        } else if (arg.rfind("--profile=", 0) == 0) {
+            profile = true;
+            profile_out = arg.substr(std::strlen("--profile="));
+        } else if (arg == "--sample") {
+            sample_hz = 99;
+        } else if (arg.rfind("--sample=", 0) == 0) {
+            sample_hz = static_cast<unsigned>(std::stoul(arg.substr(std::strlen("--sample="))));
+        } else if (arg == "--opstats") {
+            opstats = true;
+        } else if (arg.rfind("--opstats=", 0) == 0) {
+            opstats = true;
+            opstats_out = arg.substr(std::strlen("--opstats="));
+        } else if (arg == "--perf-counters") {
+            perf = true;
+        } else if (arg.rfind("--perf-counters=", 0) == 0) {
+            perf = true;
+            perf_window = std::stoull(arg.substr(std::strlen("--perf-counters=")));
+        } else if (arg == "--folded" && i + 1 < argc) {
+            folded_out = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = true;
+            job_opt.threads = std::stoul(argv[++i]);
+        } else if (arg == "--entry" && i + 1 < argc) {
+            job_opt.entry = argv[++i];
+        } else if (arg == "--inputs" && i + 1 < argc) {
+            inputs_path = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serve_on = argv[++i];
+        } else if (arg == "--instances" && i + 1 < argc) {
+            instances = std::stoul(argv[++i]);
+        } else if (arg == "--event-loop") {
+            event_loop = true;
+        } else if (arg == "--slice" && i + 1 < argc) {
+            slice = std::stoull(argv[++i]);
+        } else if (arg == "--fuel" && i + 1 < argc) {
+            fuel = std::stoll(argv[++i]);
+        } else if (arg == "--fuel-costs" && i + 1 < argc) {
+            fuel_costs = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--snapshot-out" && i + 1 < argc) {
+            snapshot_out = argv[++i];
+        } else if (arg == "--snapshot-in" && i + 1 < argc) {
+            snapshot_in = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << "\n";
+            usage();
+            return 1;
+        } else {
+            filename = arg;
+        }
+    }
+
+    if (filename.empty() == snapshot_in.empty()) {
+        usage();
+        return 1;
+    }
+    if (int(profile) + int(opstats) + int(perf) > 1) {
+        std::cerr << "--profile, --opstats and --perf-counters are separate runs, pick one\n";
+        return 1;
+    }
+    if ((!snapshot_out.empty() || !snapshot_in.empty()) && (profile || opstats || perf || jobs)) {
+        std::cerr << "snapshots only combine with plain runs and --sample\n";
+        return 1;
+    }
+
+    if (!serve_on.empty()) {
+        if (profile || opstats || perf || sample_hz || jobs || !snapshot_in.empty() || !snapshot_out.empty()) {
+            std::cerr << "--serve runs on its own\n";
+            return 1;
+        }
+        try {
+            Server server(Program::map(filename, true), threads);
+            if (serve_on == "-") server.serve(std::cin, std::cout);
+            else server.listen(serve_on);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (fuel >= 0 && (profile || opstats || perf || jobs || instances || !serve_on.empty())) {
+        std::cerr << "--fuel meters plain runs only\n";
+        return 1;
+    }
+
+    if (event_loop && !instances) {
+        std::cerr << "--event-loop needs --instances\n";
         return 1;
     }
 
-    std::string filename = argv[1];
+    if (instances) {
+        if (profile || opstats || perf || sample_hz || jobs || !snapshot_in.empty() || !snapshot_out.empty()) {
+            std::cerr << "--instances runs on its own\n";
+            return 1;
+        }
+        try {
+            auto program = Program::map(filename);
+            std::vector<std::ostringstream> outs(instances);
+            uint64_t slices;
+            if (event_loop) {
+                IoLoop loop(slice);
+                for (size_t k = 0; k < instances; ++k) {
+                    auto vm = std::make_unique<VM>(program);
+                    vm->out = &outs[k];
+                    loop.add(std::move(vm));
+                }
+                loop.run();
+                slices = loop.slices();
+            } else {
+                Scheduler sched(threads, slice);
+                for (size_t k = 0; k < instances; ++k) {
+                    auto vm = std::make_unique<VM>(program);
+                    vm->out = &outs[k];
+                    sched.spawn(std::move(vm));
+                }
+                sched.wait();
+                slices = sched.slices();
+            }
+            for (const auto& o : outs) std::cout << o.str();
+            std::cerr << "[vm] " << instances << " instances in " << slices << " slices\n";
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        std::cout << "[vm] Execution complete.\n";
+        return 0;
+    }
+
+    if (jobs) {
+        if (profile || opstats || perf || sample_hz) {
+            std::cerr << "--jobs cannot be combined with the profiling modes\n";
+            return 1;
+        }
+
+        std::vector<std::string> inputs;
+        std::ifstream file;
+        if (!inputs_path.empty()) {
+            file.open(inputs_path);
+            if (!file) {
+                std::cerr << "Failed to open input file: " << inputs_path << "\n";
+                return 1;
+            }
+        }
+        std::istream& in = inputs_path.empty() ? std::cin : file;
+        for (std::string line; std::getline(in, line);) inputs.push_back(line);
+
+        try {
+            auto program = Program::map(filename, true);
+            return runJobs(program, job_opt, inputs, std::cout) ? 1 : 0;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
 
     VM vm;
+    vm.load_symbols = profile || sample_hz || opstats || !folded_out.empty();
+
+    if (!snapshot_in.empty()) {
+        try {
+            restoreSnapshot(vm, snapshot_in);
+        } catch (const std::exception& e) {
+            std::cerr << snapshot_in << ": " << e.what() << "\n";
+            return 1;
+        }
+    } else {
+        // a snapshot keeps the symbols, so the resumed process can still be profiled
+        vm.load_symbols |= !snapshot_out.empty();
+        vm.loadProgram(filename);
+    }
+    vm.stop_at_checkpoint = !snapshot_out.empty();
+
+    // The first SPAWN stops the VM (needs_scheduler), and a plain run
+    // carries on from there on the work-stealing scheduler; nothing has to
+    // look through the code up front.
+    vm.spawn_suspends = true;
+    auto fibersOnly = [] {
+        std::cerr << "programs using SPAWN only combine with --threads and --slice\n";
+        return 1;
+    };
 
-    vm.loadProgram(assembler::readFile(filename));
+    auto openOut = [](const std::string& path) {
+        std::ofstream out(path);
+        if (!out) throw std::runtime_error("Failed to open output file: " + path);
+        return out;
+    };
 
-    vm.run();
+    // the sampler only reads the VM from its signal handler, so it can sit
+    // on top of either dispatch loop
+    Sampler sampler(vm);
+    if (sample_hz && !sampler.start(sample_hz))
+        std::cerr << "[warn] SIGPROF sampling unavailable, running unsampled\n";
 
+    if (profile) {
+        Profiler prof(vm);
+        vm.runObserved(prof);
+        prof.finish();
+        sampler.stop();
+        if (vm.needs_scheduler) return fibersOnly();
 
+        if (profile_out.empty()) {
+            prof.report(std::cerr);
+        } else {
+            auto out = openOut(profile_out);
+            prof.report(out);
+        }
+        if (!folded_out.empty()) {
+            auto out = openOut(folded_out);
+            prof.writeFolded(out);
+        }
+        if (sample_hz) sampler.report(std::cerr);
+    } else if (opstats) {
+        OpStats stats(vm);
+        vm.runObserved(stats);
+        sampler.stop();
+        if (vm.needs_scheduler) return fibersOnly();
 
+        if (opstats_out.empty()) {
+            stats.writeJson(std::cerr);
+        } else {
+            auto out = openOut(opstats_out);
+            stats.writeJson(out);
+        }
+        if (sample_hz) sampler.report(std::cerr);
+    } else if (perf) {
+        PerfCounters counters;
+        if (!counters.available())
+            std::cerr << "[warn] hardware counters unavailable (" << counters.error() << "), running without them\n";
+
+        if (perf_window) {
+            PerfWindows windows(counters, perf_window);
+            counters.start();
+            vm.runObserved(windows);
+            counters.stop();
+            if (vm.needs_scheduler) return fibersOnly();
+            windows.finish();
+            if (counters.available()) windows.report(std::cerr);
+        } else {
+            counters.start();
+            vm.run();
+            counters.stop();
+            if (vm.needs_scheduler) return fibersOnly();
+            if (counters.available()) reportPerfTotals(std::cerr, counters, counters.read());
+        }
+        sampler.stop();
+        if (sample_hz) sampler.report(std::cerr);
+    } else if (fuel >= 0) {
+        FuelSchedule schedule;
+        if (!fuel_costs.empty()) {
+            std::ifstream costs(fuel_costs);
+            if (!costs) throw std::runtime_error("Failed to open fuel costs: " + fuel_costs);
+            schedule = FuelSchedule::parse(costs);
+        }
+        FuelTable table = FuelTable::build(*vm.program, schedule);
+
+        vm.fuel = fuel;
+        if (snapshot_in.empty()) vm.pc = 0;
+        // carry on after I/O and YIELD; a SPAWN is dealt with below
+        RunStatus status = vm.resumeMetered(table);
+        while (status == RunStatus::Pending || (status == RunStatus::Preempted && !vm.needs_scheduler)) {
+            if (status == RunStatus::Pending) vm.io->wait(vm.io_ticket);
+            status = vm.resumeMetered(table);
+        }
+        sampler.stop();
+        if (vm.needs_scheduler) return fibersOnly();
+        if (sample_hz) sampler.report(std::cerr);
+
+        std::cerr << "[vm] Fuel used: " << fuel - vm.fuel << "\n";
+        if (status == RunStatus::OutOfFuel) {
+            std::cerr << "[vm] Out of fuel at pc " << vm.pc << "\n";
+            return 2;
+        }
+    } else {
+        if (snapshot_in.empty()) vm.run();
+        else vm.resume();
+        sampler.stop();
+
+        // the program spawned fibers: carry on from that SPAWN on the
+        // scheduler, with this VM as the first fiber
+        if (vm.needs_scheduler) {
+            if (sample_hz || !snapshot_out.empty()) return fibersOnly();
+            try {
+                Scheduler sched(threads, slice);
+                sched.spawn(std::make_unique<VM>(std::move(vm)));
+                sched.wait();
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+                return 1;
+            }
+            std::cout << "[vm] Execution complete.\n";
+            return 0;
+        }
+
+        if (sample_hz) sampler.report(std::cerr);
+        if (!folded_out.empty()) {
+            auto out = openOut(folded_out);
+            sampler.writeFolded(out);
+        }
+    }
+
+    if (!snapshot_out.empty()) {
+        if (!vm.checkpointed) {
+            std::cerr << "program finished without reaching CHECKPOINT, no snapshot written\n";
+            return 1;
+        }
+        writeSnapshot(vm, snapshot_out);
+        std::cerr << "[vm] Snapshot written to " << snapshot_out << "\n";
+        return 0;
+    }
 
     std::cout << "[vm] Execution complete.\n";
     return 0;
+} catch (const std::exception& e) {
+    // a runtime error in the program (deadlock, bad operand, ...) or a file
+    // that could not be read or written
+    std::cerr << e.what() << "\n";
+    return 1;
 }
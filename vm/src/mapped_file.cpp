@@ -0,0 +1,67 @@
+#include "mapped_file.hpp"
+#include "detvm.hpp"
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DETVM_HAVE_MMAP 1
+#endif
+
+namespace detvm {
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef DETVM_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat file: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+
+    if (size_ > 0) {
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            data_ = static_cast<const uint8_t*>(p);
+            mapped_ = true;
+        }
+    }
+    ::close(fd);
+    if (mapped_ || size_ == 0) return;
+#endif
+    fallback_ = assembler::readFile(path);
+    data_ = fallback_.data();
+    size_ = fallback_.size();
+}
+
+MappedFile::MappedFile(std::vector<uint8_t> bytes) : fallback_(std::move(bytes)) {
+    data_ = fallback_.data();
+    size_ = fallback_.size();
+}
+
+std::shared_ptr<const MappedArray> MappedArray::open(const std::string& path, Kind kind) {
+    const size_t width = kind == Kind::Int32 ? 4 : kind == Kind::Double ? 8 : 1;
+    auto file = std::make_shared<const MappedFile>(path);
+    if (file->size() % width)
+        throw std::runtime_error(path + ": " + std::to_string(file->size()) + " bytes is not a whole number of " +
+                                 std::to_string(width) + "-byte elements");
+    auto a = std::make_shared<MappedArray>();
+    a->base = file->data();
+    a->count = file->size() / width;
+    a->kind = kind;
+    a->file = std::move(file);
+    return a;
+}
+
+MappedFile::~MappedFile() {
+#ifdef DETVM_HAVE_MMAP
+    if (mapped_) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
+
+} // namespace detvm
@@ -0,0 +1,77 @@
+#include "natives.hpp"
+#include <cmath>
+
+namespace detvm {
+
+void NativeRegistry::add(const std::string& name, NativeFn fn, uint16_t params) {
+    if (!fn) throw std::runtime_error("native " + name + ": null function");
+    table_[name] = Native{fn, params};
+}
+
+const Native* NativeRegistry::find(const std::string& name) const {
+    auto it = table_.find(name);
+    return it == table_.end() ? nullptr : &it->second;
+}
+
+std::vector<Native> NativeRegistry::bind(const Program& program) const {
+    std::vector<Native> bound;
+    bound.reserve(program.natives.size());
+    for (const auto& name : program.natives) {
+        const Native* n = find(name);
+        if (!n) throw std::runtime_error("unresolved native function: " + name);
+        bound.push_back(*n);
+    }
+    return bound;
+}
+
+// === Builtins ===
+
+static Value nativeFnv1a(const Value* args, size_t) {
+    uint32_t h = 2166136261u;
+    for (unsigned char ch : args[0].str()) {
+        h ^= ch;
+        h *= 16777619u;
+    }
+    return Value(static_cast<int32_t>(h));
+}
+
+static Value nativeParseInt(const Value* args, size_t) {
+    const std::string s = args[0].str();
+    size_t used = 0;
+    int32_t v = 0;
+    try {
+        v = std::stoi(s, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != s.size()) throw std::runtime_error("parse_int: not an integer: \"" + s + "\"");
+    return Value(v);
+}
+
+static Value nativeSqrt(const Value* args, size_t) { return Value(std::sqrt(args[0].asFloat())); }
+
+static Value nativeMapI32(const Value* args, size_t) {
+    return Value(MappedArray::open(args[0].str(), MappedArray::Kind::Int32));
+}
+static Value nativeMapF64(const Value* args, size_t) {
+    return Value(MappedArray::open(args[0].str(), MappedArray::Kind::Double));
+}
+static Value nativeMapBytes(const Value* args, size_t) {
+    return Value(MappedArray::open(args[0].str(), MappedArray::Kind::Bytes));
+}
+
+const NativeRegistry& NativeRegistry::builtins() {
+    static const NativeRegistry reg = [] {
+        NativeRegistry r;
+        r.add("fnv1a", &nativeFnv1a, 1);
+        r.add("parse_int", &nativeParseInt, 1);
+        r.add("sqrt", &nativeSqrt, 1);
+        r.add("map_i32", &nativeMapI32, 1);
+        r.add("map_f64", &nativeMapF64, 1);
+        r.add("map_bytes", &nativeMapBytes, 1);
+        return r;
+    }();
+    return reg;
+}
+
+} // namespace detvm
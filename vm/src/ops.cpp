@@ -1,10 +1,18 @@
 #include "detvm.hpp"
+#include "scheduler.hpp"
+#include "channel.hpp"
+#include "shared_array.hpp"
+#include "parallel.hpp"
+#include "natives.hpp"
+#include "io_service.hpp"
+#include <thread>
+#include <atomic>
 
 namespace detvm {
 
 
 void VM::op_loadc(const Instruction& i) { 
-    Value val = constant_pool[i.b];
+    Value val = program->constant_pool[i.b];
     regs[i.a] = val;
     pc++;
 }
@@ -68,7 +76,8 @@ void VM::op_or(const Instruction& i) {
 }
 
 
-void VM::op_print(const Instruction& i) { std::cout << regs[i.a].str() << "\n"; pc++; }
+// one write per line, so fibers printing at the same time never interleave mid-line
+void VM::op_print(const Instruction& i) { (*out) << (regs[i.a].str() + "\n"); pc++; }
 
 void VM::op_newarr(const Instruction& i) {
     size_t len = static_cast<size_t>(i.c); // cast to size_t for safety
@@ -80,20 +89,24 @@ void VM::op_newarr(const Instruction& i) {
     }
 
     // Optional: log the allocation
-    std::cout << "[VM] Allocating array of length " << len
+    (*out) << "[VM] Allocating array of length " << len
               << " into register %r" << int(i.a) << "\n";
 
+    fuel -= element_cost_ * static_cast<int64_t>(len);
+
     try {
-        regs.at(i.a).data = std::vector<Value>(len); // may throw std::bad_alloc
+        regs.at(i.a).data = std::make_shared<std::vector<Value>>(len); // may throw std::bad_alloc
     } catch (const std::bad_alloc&) {
         throw std::runtime_error("[VM ERROR] NEWARR failed: out of memory");
     }
+    pc++;
 }
 
 void VM::op_loadarr(const Instruction& i) {
     int32_t index = regs[i.c].asInt();
     try {
-        regs[i.a] = regs[i.b].asArray().at(index); // Safe access!
+        Value v = regs[i.b].element(index); // Safe access!
+        regs[i.a] = std::move(v);
     } catch (const std::out_of_range& e) {
         // Halt VM and report a memory safety violation
         std::cerr << "[VM ERROR AT " << pc << "] Array read out of bounds at index " << index << "\n";
@@ -113,51 +126,59 @@ void VM::op_storearr(const Instruction& i) {
     pc++;
 }
 void VM::op_len(const Instruction& i) {
-    regs[i.a] = Value((int32_t)regs[i.b].asArray().size());
+    regs[i.a] = Value((int32_t)regs[i.b].length());
     pc++;
 }
 
 void VM::op_jmp(const Instruction& i) {
-    pc = i.a; // direct label (resolved as instruction index)
+    jumpTo(i.a); // direct label (resolved as instruction index)
 }
 
 void VM::op_jz(const Instruction& i) {
-    if (!regs[i.a].asInt()) pc = i.b;
+    if (!regs[i.a].asInt()) jumpTo(i.b);
     else pc++;
 }
 
 void VM::op_jnz(const Instruction& i) {
-    if (regs[i.a].asInt()) pc = i.b;
+    if (regs[i.a].asInt()) jumpTo(i.b);
     else pc++;
 }
 
 void VM::op_jl(const Instruction& i) {
-    if (regs[i.a].asInt() < 0) pc = i.b;
+    if (regs[i.a].asInt() < 0) jumpTo(i.b);
     else pc++;
 }
 
 void VM::op_jg(const Instruction& i) {
-    if (regs[i.a].asInt() > 0) pc = i.b;
+    if (regs[i.a].asInt() > 0) jumpTo(i.b);
     else pc++;
 }
 
-constexpr size_t RETURN_REG = 0; // always return to regs[0]
-
 
 void VM::op_enter(const Instruction& i) {
     Frame f;
     f.return_pc = pc + 1;
     f.locals.resize(i.c);
     f.args.resize(i.b);
-    callstack.push(f);
+
+    frames_busy = 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    callstack.push(std::move(f));
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    frames_busy = 0;
 }
 
 
 void VM::op_leave(const Instruction&) {
     if (callstack.empty()) return;
 
-    Frame f = callstack.top();
+    Frame f = std::move(callstack.top());
+
+    frames_busy = 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
     callstack.pop();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    frames_busy = 0;
 
      // cleanup RAII for locals
     for (auto& v : f.locals) {
@@ -177,6 +198,7 @@ void VM::op_call(const Instruction& i) {
     uint16_t argc = i.b;          // number of arguments
     size_t func_pc = i.a;        // target function PC
     uint16_t localc = i.c;
+    program->enter(func_pc);
     // push new frame
     op_enter({Opcode::ENTER, 0 , argc, localc}); // argc is passed as op_enter's i.a
 
@@ -187,7 +209,7 @@ void VM::op_call(const Instruction& i) {
     }
     
     // jump to function start
-    pc = func_pc;
+    branch(func_pc);
 }
 
 // Return from function
@@ -195,7 +217,7 @@ void VM::op_ret(const Instruction& i) {
     Value retVal;
 
     if (callstack.empty()) {
-        pc = code.size(); // terminate program
+        pc = program->code.size(); // terminate program
         return;
     }
 
@@ -206,10 +228,15 @@ void VM::op_ret(const Instruction& i) {
         retVal = f.locals[i.a];
 
     // leave frame (cleans locals and restores PC)
+    const size_t at = pc;
     op_leave({});
+    const size_t to = pc;
 
     // store return value into fixed return register
     regs[RETURN_REG] = retVal;
+
+    pc = at;
+    branch(to);
 }
 
 
@@ -279,31 +306,31 @@ void VM::op_or_local(const Instruction& i) {
 // Jumps operate on local condition variables
 void VM::op_jz_local(const Instruction& i) {
     auto& frame = callstack.top();
-    if (!frame.locals[i.a].asInt()) pc = i.b;
+    if (!frame.locals[i.a].asInt()) jumpTo(i.b);
     else pc++;
 }
 
 void VM::op_jnz_local(const Instruction& i) {
     auto& frame = callstack.top();
-    if (frame.locals[i.a].asInt()) pc = i.b;
+    if (frame.locals[i.a].asInt()) jumpTo(i.b);
     else pc++;
 }
 
 void VM::op_jl_local(const Instruction& i) {
     auto& frame = callstack.top();
-    if (frame.locals[i.a].asInt() < 0) pc = i.b;
+    if (frame.locals[i.a].asInt() < 0) jumpTo(i.b);
     else pc++;
 }
 
 void VM::op_jg_local(const Instruction& i) {
     auto& frame = callstack.top();
-    if (frame.locals[i.a].asInt() > 0) pc = i.b;
+    if (frame.locals[i.a].asInt() > 0) jumpTo(i.b);
     else pc++;
 }
 
 void VM::op_loadc_local(const Instruction& i) {
     auto& frame = callstack.top();
-    Value val = constant_pool[i.b];
+    Value val = program->constant_pool[i.b];
     frame.locals[i.a] = val;
     pc++;
 }
@@ -333,8 +360,319 @@ void VM::op_nop(const Instruction&) {
 }
 
 void VM::op_halt(const Instruction&) {
-    std::cout << "HALT encountered. Stopping VM.\n";
-    pc = code.size(); // terminate loop
+    (*out) << "HALT encountered. Stopping VM.\n";
+    pc = program->code.size(); // terminate loop
+}
+
+void VM::op_checkpoint(const Instruction&) {
+    if (!stop_at_checkpoint) {
+        pc++;
+        return;
+    }
+    checkpointed = true;
+    checkpoint_pc = pc + 1;
+    pc = program->code.size(); // leave the dispatch loop; the host takes the snapshot
+}
+
+// === Fibers ===
+
+// Same operands as CALL, but the callee gets a VM of its own, run by the
+// scheduler alongside this one; only the fiber's id comes back.
+void VM::op_spawn(const Instruction& i) {
+    if (!scheduler) {
+        if (!spawn_suspends) throw std::runtime_error("SPAWN needs a fiber scheduler (detvm Scheduler)");
+        needs_scheduler = true;
+        preempted_ = true;
+        preempt_pc_ = pc;
+        pc = program->code.size();
+        return;
+    }
+
+    if (i.b > params.size()) throw std::runtime_error("SPAWN: too many arguments");
+    program->enter(i.a);
+
+    auto fiber = std::make_unique<VM>(program, regs.size());
+    fiber->out = out;
+    fiber->channels = channels;
+    fiber->shared = shared;
+    fiber->natives = natives;
+    fiber->io = io;
+    Frame f;
+    f.locals.resize(i.c);
+    f.args.assign(params.begin(), params.begin() + i.b);
+    f.return_pc = program->code.size(); // returning from it ends the fiber
+    fiber->callstack.push(std::move(f));
+    fiber->pc = i.a;
+
+    regs[RETURN_REG] = Value(static_cast<int32_t>(scheduler->spawn(std::move(fiber))));
+    pc++;
+}
+
+void VM::op_yield(const Instruction&) {
+    preempted_ = true;
+    preempt_pc_ = pc + 1;
+    pc = program->code.size();
+}
+
+void VM::op_join(const Instruction& i) {
+    if (!scheduler) throw std::runtime_error("JOIN needs a fiber scheduler (detvm Scheduler)");
+    const int32_t id = regs[i.a].asInt();
+    if (scheduler->result(id, regs[RETURN_REG])) {
+        joining = -1;
+        pc++;
+        return;
+    }
+    // not done yet: the scheduler parks us and runs this JOIN again once it is
+    joining = id;
+    preempted_ = true;
+    preempt_pc_ = pc;
+    pc = program->code.size();
+}
+
+// === Channels ===
+
+void VM::op_chnew(const Instruction& i) {
+    if (!channels) channels = std::make_shared<ChannelTable>();
+    regs[i.a] = Value(channels->create(i.c));
+    pc++;
+}
+
+static Channel& channelOf(const std::shared_ptr<ChannelTable>& channels, const Value& id) {
+    if (!channels) throw std::runtime_error("no channel " + id.str() + " (nothing has called CHNEW)");
+    return channels->at(id.asInt());
+}
+
+void VM::op_chsend(const Instruction& i) {
+    Scheduler* s = scheduler ? scheduler : caller_scheduler_;
+    const uint64_t seen = s ? s->channelMoves() : 0;
+    if (channelOf(channels, regs[i.a]).push(regs[i.b])) {
+        if (s) s->channelMoved();
+        pc++;
+    } else {
+        waitOnChannel("CHSEND", regs[i.a], seen);
+    }
+}
+
+void VM::op_chrecv(const Instruction& i) {
+    Scheduler* s = scheduler ? scheduler : caller_scheduler_;
+    const uint64_t seen = s ? s->channelMoves() : 0;
+    if (channelOf(channels, regs[i.b]).pop(regs[i.a])) {
+        if (s) s->channelMoved();
+        pc++;
+    } else {
+        waitOnChannel("CHRECV", regs[i.b], seen);
+    }
+}
+
+void VM::op_chtry(const Instruction& i) {
+    const bool got = channelOf(channels, regs[i.b]).pop(regs[i.a]);
+    if (Scheduler* s = scheduler ? scheduler : caller_scheduler_; got && s) s->channelMoved();
+    regs[i.c] = Value(got);
+    pc++;
+}
+
+// The blocked instruction runs again once the VM is resumed: under a
+// Scheduler once some channel moved after `seen`, otherwise whenever its
+// host resumes it. A VM nobody else shares the channels with would wait
+// forever.
+void VM::waitOnChannel(const char* op, const Value& id, uint64_t seen) {
+    if (scheduler) channel_wait = static_cast<int64_t>(seen);
+    else if (channels.use_count() == 1)
+        throw std::runtime_error(std::string(op) + " deadlock: channel " + id.str() +
+                                 " can never be ready, no other VM shares it");
+    preempted_ = true;
+    preempt_pc_ = pc;
+    pc = program->code.size();
+    rerun_paid_ = true;
+}
+
+// === Shared arrays ===
+
+void VM::op_shnew(const Instruction& i) {
+    if (!shared) shared = std::make_shared<SharedArrays>();
+    regs[i.a] = Value(shared->create(i.c));
+    pc++;
+}
+
+static std::atomic<int32_t>& sharedSlot(const std::shared_ptr<SharedArrays>& shared, const Value& id,
+                                        const Value& index) {
+    if (!shared) throw std::runtime_error("no shared array " + id.str() + " (nothing has called SHNEW)");
+    return shared->at(id.asInt()).at(index.asInt());
+}
+
+void VM::op_aload(const Instruction& i) {
+    regs[i.a] = Value(sharedSlot(shared, regs[i.b], regs[i.c]).load(std::memory_order_acquire));
+    pc++;
+}
+
+void VM::op_astore(const Instruction& i) {
+    sharedSlot(shared, regs[i.a], regs[i.b]).store(regs[i.c].asInt(), std::memory_order_release);
+    pc++;
+}
+
+void VM::op_afetchadd(const Instruction& i) {
+    auto& slot = sharedSlot(shared, regs[i.b], regs[i.c]);
+    regs[i.a] = Value(slot.fetch_add(regs[i.a].asInt(), std::memory_order_acq_rel));
+    pc++;
+}
+
+// compare_exchange: swaps in A when the slot holds r0; A becomes whether it
+// did, r0 what the slot held
+void VM::op_acas(const Instruction& i) {
+    auto& slot = sharedSlot(shared, regs[i.b], regs[i.c]);
+    int32_t expected = regs[RETURN_REG].asInt();
+    bool ok = slot.compare_exchange_strong(expected, regs[i.a].asInt(), std::memory_order_acq_rel,
+                                           std::memory_order_acquire);
+    regs[i.a] = Value(ok);
+    regs[RETURN_REG] = Value(expected);
+    pc++;
+}
+
+void VM::op_fence(const Instruction&) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    pc++;
+}
+
+// === PARMAP / PARREDUCE ===
+
+VM VM::helper() const {
+    VM w(program, regs.size());
+    w.out = out;
+    w.channels = channels;
+    w.shared = shared;
+    w.natives = natives;
+    w.io = io;
+    // metered: charges what it runs to its own fuel, for the caller to collect
+    w.element_cost_ = element_cost_;
+    w.metered_ = metered_;
+    w.fuel = INT64_MAX;
+    w.caller_scheduler_ = scheduler ? scheduler : caller_scheduler_;
+    return w;
+}
+
+// The function runs on helper VMs without a scheduler, so it may use
+// channels and shared arrays but not SPAWN/JOIN.
+static FunctionSymbol parallelFunction(const Instruction& i, uint16_t params) {
+    const char* name = i.opcode == Opcode::PARMAP ? "PARMAP" : "PARREDUCE";
+    if (i.b != params)
+        throw std::runtime_error(std::string(name) + ": function must take " + std::to_string(params) +
+                                 " parameter(s), not " + std::to_string(i.b));
+    FunctionSymbol fn;
+    fn.name = name;
+    fn.pc_start = i.a;
+    fn.params = i.b;
+    fn.locals = i.c;
+    return fn;
+}
+
+static void checkParallelInput(const Value& v, const char* op) {
+    if (!v.isArray()) throw std::runtime_error(std::string(op) + ": %p0 must hold an array");
+}
+
+void VM::op_parmap(const Instruction& i) {
+    const FunctionSymbol fn = parallelFunction(i, 1);
+    const Value input = params[0]; // keeps the array alive and unchanged while workers read it
+    checkParallelInput(input, "PARMAP");
+    fuel -= element_cost_ * static_cast<int64_t>(input.length());
+
+    ThreadPool& pool = scheduler ? scheduler->pool() : defaultPool();
+    std::vector<Value> mapped(input.length());
+    std::atomic<int64_t> used{0};
+    parallelFor(pool, mapped.size(), pool.size() * 4, [&](size_t begin, size_t end) {
+        VM w = helper();
+        for (size_t k = begin; k < end; ++k) {
+            const Value x = input.element(k);
+            mapped[k] = w.call(fn, &x, 1);
+        }
+        used += INT64_MAX - w.fuel;
+    });
+    fuel -= used;
+
+    regs[RETURN_REG] = Value(std::move(mapped));
+    pc++;
+}
+
+// Each chunk folds its own elements, then the chunk results are folded in
+// order onto p1, so the result matches a serial fold for associative funcs.
+void VM::op_parreduce(const Instruction& i) {
+    const FunctionSymbol fn = parallelFunction(i, 2);
+    const Value input = params[0];
+    checkParallelInput(input, "PARREDUCE");
+    fuel -= element_cost_ * static_cast<int64_t>(input.length());
+
+    ThreadPool& pool = scheduler ? scheduler->pool() : defaultPool();
+    const size_t n = input.length();
+    const size_t chunks = std::min(n, pool.size() * 4);
+    std::vector<Value> partial(chunks);
+    std::atomic<int64_t> used{0};
+    parallelFor(pool, n, chunks, [&](size_t begin, size_t end) {
+        VM w = helper();
+        Value pair[2] = {input.element(begin), Value()};
+        for (size_t k = begin + 1; k < end; ++k) {
+            pair[1] = input.element(k);
+            pair[0] = w.call(fn, pair, 2);
+        }
+        partial[(begin * chunks + n - 1) / n] = std::move(pair[0]); // begin == k * n / chunks
+        used += INT64_MAX - w.fuel;
+    });
+
+    VM w = helper();
+    Value pair[2] = {params[1], Value()};
+    for (auto& p : partial) {
+        pair[1] = std::move(p);
+        pair[0] = w.call(fn, pair, 2);
+    }
+    fuel -= used + (INT64_MAX - w.fuel);
+    regs[RETURN_REG] = std::move(pair[0]);
+    pc++;
+}
+
+// === Native calls ===
+
+void VM::op_calln(const Instruction& i) {
+    if (!natives) natives = std::make_shared<const std::vector<Native>>(NativeRegistry::builtins().bind(*program));
+    // a hand-written or damaged TEXT can name an import the program never declared
+    if (i.a >= natives->size()) throw std::runtime_error("CALLN: no native import " + std::to_string(i.a));
+    const Native& n = (*natives)[i.a];
+    if (n.params > params.size()) throw std::runtime_error("CALLN: native takes more arguments than there are %p registers");
+    regs[RETURN_REG] = n.fn(params.data(), n.params);
+    pc++;
+}
+
+
+// === Asynchronous file I/O ===
+
+void VM::op_fread(const Instruction& i) {
+    if (io_ticket < 0) {
+        if (!io) io = IoService::global();
+        io_ticket = io->read(regs[i.b].str());
+    }
+    awaitIo(i.a);
+}
+
+void VM::op_fwrite(const Instruction& i) {
+    if (io_ticket < 0) {
+        if (!io) io = IoService::global();
+        io_ticket = io->write(regs[i.b].str(), regs[i.c].str());
+    }
+    awaitIo(i.a);
+}
+
+// Completes the FREAD/FWRITE at pc if its request is done. Otherwise the
+// VM suspends, and whoever drives it runs this instruction again once the
+// request completes.
+void VM::awaitIo(uint16_t dst) {
+    const int64_t ticket = io_ticket;
+    io_ticket = -1; // a failed request must not be waited on again
+    if (io->take(ticket, regs[dst])) {
+        pc++;
+        return;
+    }
+    io_ticket = ticket;
+    preempted_ = true;
+    preempt_pc_ = pc;
+    pc = program->code.size();
+    rerun_paid_ = true; // runs again to take the result, which must not cost fuel twice
 }
 
 
@@ -379,9 +717,9 @@ void VM::op_raiidrop(const Instruction& i) {
     // Auto-drop owned resource (simulate destructor)
     if (regs[i.a].refcount > 1) {
         regs[i.a].refcount--;
-        std::cout << "[RAII] Decremented refcount -> " << regs[i.a].refcount << "\n";
+        (*out) << "[RAII] Decremented refcount -> " << regs[i.a].refcount << "\n";
     } else {
-        std::cout << "[RAII] Dropped value in r" << (int)i.a << "\n";
+        (*out) << "[RAII] Dropped value in r" << (int)i.a << "\n";
         regs[i.a] = Value(); // clear content
     }
     pc++;
@@ -0,0 +1,124 @@
+#include "opstats.hpp"
+#include "observed_run.hpp"
+#include <algorithm>
+#include <iomanip>
+
+namespace detvm {
+
+static bool isConditionalJump(Opcode op) {
+    switch (op) {
+        case Opcode::JZ:  case Opcode::JNZ:  case Opcode::JL:  case Opcode::JG:
+        case Opcode::JLZ: case Opcode::JLNZ: case Opcode::JLL: case Opcode::JLG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Evaluated before the jump runs, from the same operand it tests: where pc
+// ends up cannot tell a taken jump to pc + 1 from a fall-through.
+static bool branchTaken(const VM& vm, const Instruction& inst) {
+    const bool local = inst.opcode == Opcode::JLZ || inst.opcode == Opcode::JLNZ ||
+                       inst.opcode == Opcode::JLL || inst.opcode == Opcode::JLG;
+    const int32_t v = local ? vm.callstack.top().locals[inst.a].asInt() : vm.regs[inst.a].asInt();
+    switch (inst.opcode) {
+        case Opcode::JZ:  case Opcode::JLZ:  return v == 0;
+        case Opcode::JNZ: case Opcode::JLNZ: return v != 0;
+        case Opcode::JL:  case Opcode::JLL:  return v < 0;
+        default:                             return v > 0; // JG, JLG
+    }
+}
+
+OpStats::OpStats(const VM& vm) : vm_(vm), pairs_(0x100 * 0x100, 0) {}
+
+void OpStats::before(VM& vm, size_t pc, const Instruction& inst) {
+    const uint32_t op = static_cast<uint16_t>(inst.opcode) & 0xFF;
+    ++instrs_;
+    ++counts_[op];
+
+    // a jump target starts a new straight-line run
+    if (pc != last_pc_ + 1) run_len_ = 0;
+
+    if (run_len_ >= 1) ++pairs_[((run_ & 0xFF) << 8) | op];
+    if (run_len_ >= 2) ++triples_[((run_ & 0xFFFF) << 8) | op];
+
+    run_ = (run_ << 8) | op;
+    run_len_ = std::min<uint32_t>(run_len_ + 1, 2);
+    last_pc_ = pc;
+
+    if (isConditionalJump(inst.opcode)) taken_ = branchTaken(vm, inst);
+}
+
+void OpStats::after(VM&, size_t pc, const Instruction& inst) {
+    if (!isConditionalJump(inst.opcode)) return;
+    BranchSite& site = branches_[pc];
+    site.op = inst.opcode;
+    if (taken_) ++site.taken;
+    else ++site.not_taken;
+}
+
+static std::string opName(uint32_t op) {
+    return opcodeName(static_cast<Opcode>(op));
+}
+
+void OpStats::writeJson(std::ostream& out, size_t top_n) const {
+    const double total = instrs_ ? static_cast<double>(instrs_) : 1.0;
+    out << std::fixed << std::setprecision(4);
+
+    out << "{\n  \"instructions\": " << instrs_ << ",\n";
+
+    // === OPCODES ===
+    std::vector<uint32_t> ops;
+    for (uint32_t op = 0; op < counts_.size(); ++op)
+        if (counts_[op]) ops.push_back(op);
+    std::sort(ops.begin(), ops.end(), [&](uint32_t a, uint32_t b) { return counts_[a] > counts_[b]; });
+
+    out << "  \"opcodes\": [";
+    for (size_t i = 0; i < ops.size(); ++i) {
+        out << (i ? ",\n" : "\n")
+            << "    {\"op\": \"" << opName(ops[i]) << "\", \"count\": " << counts_[ops[i]]
+            << ", \"fraction\": " << counts_[ops[i]] / total << "}";
+    }
+    out << "\n  ],\n";
+
+    // === PAIRS / TRIPLES ===
+    auto writeGrams = [&](const char* key, std::vector<std::pair<uint32_t, uint64_t>> grams, int n) {
+        std::sort(grams.begin(), grams.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        if (grams.size() > top_n) grams.resize(top_n);
+
+        out << "  \"" << key << "\": [";
+        for (size_t i = 0; i < grams.size(); ++i) {
+            out << (i ? ",\n" : "\n") << "    {\"seq\": [";
+            for (int k = n - 1; k >= 0; --k) {
+                out << "\"" << opName((grams[i].first >> (8 * k)) & 0xFF) << "\"" << (k ? ", " : "");
+            }
+            out << "], \"count\": " << grams[i].second << "}";
+        }
+        out << "\n  ],\n";
+    };
+
+    std::vector<std::pair<uint32_t, uint64_t>> pairs;
+    for (uint32_t key = 0; key < pairs_.size(); ++key)
+        if (pairs_[key]) pairs.push_back({key, pairs_[key]});
+    writeGrams("pairs", std::move(pairs), 2);
+    writeGrams("triples", {triples_.begin(), triples_.end()}, 3);
+
+    // === BRANCH SITES ===
+    out << "  \"branches\": [";
+    bool first = true;
+    for (const auto& [pc, site] : branches_) {
+        const FunctionSymbol* sym = vm_.functionAt(pc);
+        out << (first ? "\n" : ",\n")
+            << "    {\"pc\": " << pc << ", \"op\": \"" << opcodeName(site.op) << "\"";
+        if (sym) out << ", \"function\": \"" << sym->name << "\"";
+        out << ", \"taken\": " << site.taken << ", \"not_taken\": " << site.not_taken << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n" << std::defaultfloat;
+}
+
+template void VM::runObserved<OpStats>(OpStats&);
+
+} // namespace detvm
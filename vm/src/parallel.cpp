@@ -0,0 +1,66 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace detvm {
+
+namespace {
+
+struct ForState {
+    size_t n = 0;
+    size_t chunks = 0;
+    std::function<void(size_t, size_t)> body;
+    std::atomic<size_t> next{0}; // next chunk to claim
+    size_t done = 0;             // chunks finished, under m
+    std::exception_ptr error;
+    std::mutex m;
+    std::condition_variable all_done;
+};
+
+// Claims and runs chunks until none are left.
+void drain(ForState& s) {
+    for (;;) {
+        const size_t k = s.next.fetch_add(1, std::memory_order_relaxed);
+        if (k >= s.chunks) return;
+        try {
+            s.body(k * s.n / s.chunks, (k + 1) * s.n / s.chunks);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(s.m);
+            if (!s.error) s.error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(s.m);
+        if (++s.done == s.chunks) s.all_done.notify_all();
+    }
+}
+
+} // namespace
+
+void parallelFor(ThreadPool& pool, size_t n, size_t chunks,
+                 const std::function<void(size_t begin, size_t end)>& body) {
+    chunks = std::min(chunks, n);
+    if (chunks == 0) return;
+
+    // helpers can start after we return; the state lives as long as they do
+    auto s = std::make_shared<ForState>();
+    s->n = n;
+    s->chunks = chunks;
+    s->body = body;
+    const size_t helpers = std::min(chunks - 1, pool.size());
+    for (size_t h = 0; h < helpers; ++h) pool.submit([s] { drain(*s); });
+
+    drain(*s);
+    std::unique_lock<std::mutex> lock(s->m);
+    s->all_done.wait(lock, [&] { return s->done == s->chunks; });
+    if (s->error) std::rethrow_exception(s->error);
+}
+
+ThreadPool& defaultPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+} // namespace detvm
@@ -0,0 +1,215 @@
+#include "perf_counters.hpp"
+#include "observed_run.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <map>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace detvm {
+
+PerfCounters::Reading PerfCounters::Reading::operator-(const Reading& o) const {
+    Reading r;
+    for (size_t i = 0; i < EVENT_COUNT; ++i) r.value[i] = value[i] - o.value[i];
+    return r;
+}
+
+const char* PerfCounters::name(Event e) {
+    switch (e) {
+        case CYCLES:        return "cycles";
+        case INSTRUCTIONS:  return "instructions";
+        case BRANCH_MISSES: return "branch-misses";
+        case L1I_MISSES:    return "L1-icache-misses";
+        case L1D_MISSES:    return "L1-dcache-misses";
+        default:            return "?";
+    }
+}
+
+#ifdef __linux__
+
+static int openCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+static uint64_t cacheMiss(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+PerfCounters::PerfCounters() {
+    fds_[CYCLES]        = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds_[INSTRUCTIONS]  = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds_[BRANCH_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds_[L1I_MISSES]    = openCounter(PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1I));
+    fds_[L1D_MISSES]    = openCounter(PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D));
+
+    if (!available())
+        error_ = std::string("perf_event_open: ") + std::strerror(errno);
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds_)
+        if (fd >= 0) ::close(fd);
+}
+
+void PerfCounters::start() {
+    for (int fd : fds_) {
+        if (fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void PerfCounters::stop() {
+    for (int fd : fds_)
+        if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+}
+
+PerfCounters::Reading PerfCounters::read() const {
+    Reading r;
+    for (size_t i = 0; i < EVENT_COUNT; ++i) {
+        uint64_t v = 0;
+        if (fds_[i] >= 0 && ::read(fds_[i], &v, sizeof(v)) == sizeof(v)) r.value[i] = v;
+    }
+    return r;
+}
+
+#else
+
+PerfCounters::PerfCounters() {
+    fds_.fill(-1);
+    error_ = "hardware counters are only supported on Linux";
+}
+
+PerfCounters::~PerfCounters() = default;
+void PerfCounters::start() {}
+void PerfCounters::stop() {}
+PerfCounters::Reading PerfCounters::read() const { return {}; }
+
+#endif
+
+bool PerfCounters::available() const {
+    return std::any_of(fds_.begin(), fds_.end(), [](int fd) { return fd >= 0; });
+}
+
+// === Per-window sampling ===
+
+PerfWindows::PerfWindows(PerfCounters& counters, size_t window)
+    : counters_(counters), window_(std::max<size_t>(window, 1)) {
+    last_ = counters_.read();
+}
+
+void PerfWindows::before(VM&, size_t, const Instruction& inst) {
+    ++ops_[static_cast<uint16_t>(inst.opcode) & 0xFF];
+    if (++in_window_ == window_) close();
+}
+
+void PerfWindows::close() {
+    if (!in_window_) return;
+
+    PerfCounters::Reading now = counters_.read();
+    Window w;
+    w.vm_instrs = in_window_;
+    w.dominant = static_cast<uint8_t>(std::max_element(ops_.begin(), ops_.end()) - ops_.begin());
+    w.delta = now - last_;
+    windows_.push_back(w);
+
+    for (size_t i = 0; i < PerfCounters::EVENT_COUNT; ++i) total_.value[i] += w.delta.value[i];
+    vm_instrs_ += in_window_;
+    last_ = now;
+    in_window_ = 0;
+    ops_.fill(0);
+}
+
+void PerfWindows::finish() { close(); }
+
+static void writeTotals(std::ostream& out, const PerfCounters& counters,
+                        const PerfCounters::Reading& total, uint64_t vm_instrs) {
+    out << "=== detvm perf counters ===\n" << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+        auto e = static_cast<PerfCounters::Event>(i);
+        out << std::setw(20) << PerfCounters::name(e) << "  ";
+        if (!counters.has(e)) {
+            out << "<not supported>\n";
+            continue;
+        }
+        out << std::setw(14) << total.value[i];
+        if (vm_instrs) out << "  (" << static_cast<double>(total.value[i]) / vm_instrs << " per VM instruction)";
+        out << "\n";
+    }
+    if (counters.has(PerfCounters::CYCLES) && counters.has(PerfCounters::INSTRUCTIONS) &&
+        total.value[PerfCounters::CYCLES]) {
+        out << std::setw(20) << "IPC" << "  " << std::setw(14)
+            << static_cast<double>(total.value[PerfCounters::INSTRUCTIONS]) / total.value[PerfCounters::CYCLES]
+            << "\n";
+    }
+    if (vm_instrs) out << std::setw(20) << "VM instructions" << "  " << std::setw(14) << vm_instrs << "\n";
+    out << std::defaultfloat;
+}
+
+void reportPerfTotals(std::ostream& out, const PerfCounters& counters,
+                      const PerfCounters::Reading& total) {
+    writeTotals(out, counters, total, 0);
+}
+
+void PerfWindows::report(std::ostream& out) const {
+    writeTotals(out, counters_, total_, vm_instrs_);
+    if (windows_.empty()) return;
+
+    // === cycles per VM instruction across windows ===
+    if (counters_.has(PerfCounters::CYCLES)) {
+        std::vector<double> cpi;
+        for (const auto& w : windows_)
+            cpi.push_back(static_cast<double>(w.delta.value[PerfCounters::CYCLES]) / w.vm_instrs);
+        std::sort(cpi.begin(), cpi.end());
+        auto at = [&](double q) { return cpi[static_cast<size_t>(q * (cpi.size() - 1))]; };
+
+        out << "\n[Windows] " << windows_.size() << " x " << window_ << " VM instructions, cycles per VM instruction:"
+            << std::fixed << std::setprecision(2)
+            << "  min " << cpi.front() << "  p50 " << at(0.5) << "  p90 " << at(0.9) << "  max " << cpi.back()
+            << "\n" << std::defaultfloat;
+    }
+
+    // === breakdown by the dominant opcode of each window ===
+    std::map<uint8_t, std::pair<uint64_t, PerfCounters::Reading>> by_op;
+    for (const auto& w : windows_) {
+        auto& [instrs, sum] = by_op[w.dominant];
+        instrs += w.vm_instrs;
+        for (size_t i = 0; i < PerfCounters::EVENT_COUNT; ++i) sum.value[i] += w.delta.value[i];
+    }
+
+    out << "\n[By dominant opcode] (per VM instruction)\n"
+        << "  opcode        VM instrs";
+    for (size_t i = 0; i < PerfCounters::EVENT_COUNT; ++i)
+        if (counters_.has(static_cast<PerfCounters::Event>(i)))
+            out << std::setw(18) << PerfCounters::name(static_cast<PerfCounters::Event>(i));
+    out << "\n" << std::fixed << std::setprecision(3);
+
+    for (const auto& [op, entry] : by_op) {
+        const auto& [instrs, sum] = entry;
+        out << "  " << std::left << std::setw(10) << opcodeName(static_cast<Opcode>(op)) << std::right
+            << std::setw(13) << instrs;
+        for (size_t i = 0; i < PerfCounters::EVENT_COUNT; ++i)
+            if (counters_.has(static_cast<PerfCounters::Event>(i)))
+                out << std::setw(18) << static_cast<double>(sum.value[i]) / instrs;
+        out << "\n";
+    }
+    out << std::defaultfloat;
+}
+
+template void VM::runObserved<PerfWindows>(PerfWindows&);
+
+} // namespace detvm
@@ -0,0 +1,187 @@
+#include "profile.hpp"
+#include "observed_run.hpp"
+#include <algorithm>
+#include <iomanip>
+
+namespace detvm {
+
+static constexpr size_t NO_PARENT = static_cast<size_t>(-1);
+
+static uint64_t toNs(std::chrono::steady_clock::duration d) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+Profiler::Profiler(const VM& vm) : vm_(vm), pc_hits_(vm.program->code.size(), 0) {
+    // Code that runs outside of any frame (the entry stub at pc 0) is
+    // attributed to a pseudo function so every instruction has an owner.
+    funcs_.push_back({"<toplevel>"});
+    funcs_[0].calls = 1;
+    funcs_[0].active = 1;
+    nodes_.push_back({0, NO_PARENT, 0, {}});
+    start_ = Clock::now();
+    active_.push_back({0, 0, start_, 0});
+}
+
+size_t Profiler::funcFor(size_t entry_pc) {
+    auto it = func_index_.find(entry_pc);
+    if (it != func_index_.end()) return it->second;
+
+    FuncStats f;
+    const FunctionSymbol* sym = vm_.functionAt(entry_pc);
+    f.name = sym ? sym->name : "fn@" + std::to_string(entry_pc);
+
+    funcs_.push_back(std::move(f));
+    func_index_[entry_pc] = funcs_.size() - 1;
+    return funcs_.size() - 1;
+}
+
+void Profiler::before(VM& vm, size_t pc, const Instruction&) {
+    ++instrs_;
+    ++pc_hits_[pc];
+    ++nodes_[active_.back().node].self_instrs;
+    depth_before_ = vm.callstack.size();
+}
+
+void Profiler::after(VM& vm, size_t, const Instruction&) {
+    size_t depth = vm.callstack.size();
+    if (depth > depth_before_) enter(vm.pc);
+    else if (depth < depth_before_) leave();
+}
+
+void Profiler::enter(size_t entry_pc) {
+    size_t callee = funcFor(entry_pc);
+    const Activation& caller = active_.back();
+
+    ++edges_[(static_cast<uint64_t>(caller.func) << 32) | callee];
+    ++funcs_[callee].calls;
+    ++funcs_[callee].active;
+
+    size_t parent = caller.node;
+    size_t node;
+    auto it = nodes_[parent].children.find(callee);
+    if (it != nodes_[parent].children.end()) {
+        node = it->second;
+    } else {
+        node = nodes_.size();
+        nodes_.push_back({callee, parent, 0, {}});
+        nodes_[parent].children[callee] = node;
+    }
+
+    active_.push_back({callee, node, Clock::now(), instrs_});
+}
+
+void Profiler::leave() {
+    // never pop the <toplevel> activation; a stray RET there ends the program
+    if (active_.size() <= 1) return;
+
+    Activation a = active_.back();
+    active_.pop_back();
+
+    uint64_t elapsed = toNs(Clock::now() - a.entered);
+    FuncStats& f = funcs_[a.func];
+    f.self_ns += elapsed - std::min(elapsed, a.child_ns);
+    if (--f.active == 0) {
+        f.total_ns += elapsed;
+        f.total_instrs += instrs_ - a.instrs_at_entry;
+    }
+    active_.back().child_ns += elapsed;
+}
+
+void Profiler::finish() {
+    while (active_.size() > 1) leave();
+
+    Activation& root = active_.back();
+    uint64_t elapsed = toNs(Clock::now() - root.entered);
+    wall_ = Clock::now() - start_;
+
+    FuncStats& f = funcs_[root.func];
+    f.self_ns = elapsed - std::min(elapsed, root.child_ns);
+    f.total_ns = elapsed;
+    f.total_instrs = instrs_;
+    f.active = 0;
+
+    for (auto& fn : funcs_) fn.self_instrs = 0;
+    for (const auto& n : nodes_) funcs_[n.func].self_instrs += n.self_instrs;
+}
+
+std::string Profiler::pathOf(size_t node) const {
+    std::vector<size_t> chain;
+    for (size_t n = node; n != NO_PARENT; n = nodes_[n].parent)
+        chain.push_back(nodes_[n].func);
+
+    std::string path;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        if (!path.empty()) path += ';';
+        path += funcs_[*it].name;
+    }
+    return path;
+}
+
+void Profiler::report(std::ostream& out) const {
+    const double total = instrs_ ? static_cast<double>(instrs_) : 1.0;
+
+    std::vector<size_t> order(funcs_.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return funcs_[a].self_instrs > funcs_[b].self_instrs;
+    });
+
+    out << "=== detvm profile ===\n"
+        << instrs_ << " instructions, "
+        << std::fixed << std::setprecision(3) << toNs(wall_) / 1e6 << " ms wall\n";
+
+    // === FLAT PROFILE ===
+    out << "\n[Flat profile]\n"
+        << "   self%  self instrs  total instrs    self ms   total ms     calls  function\n";
+    for (size_t i : order) {
+        const FuncStats& f = funcs_[i];
+        out << std::setw(7) << std::setprecision(2) << 100.0 * f.self_instrs / total << "%"
+            << std::setw(13) << f.self_instrs
+            << std::setw(14) << f.total_instrs
+            << std::setw(11) << std::setprecision(3) << f.self_ns / 1e6
+            << std::setw(11) << f.total_ns / 1e6
+            << std::setw(10) << f.calls
+            << "  " << f.name << "\n";
+    }
+
+    // === CALL GRAPH ===
+    std::vector<std::pair<uint64_t, uint64_t>> edges(edges_.begin(), edges_.end());
+    std::sort(edges.begin(), edges.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+
+    out << "\n[Call graph]\n"
+        << "     calls  caller -> callee\n";
+    for (const auto& [key, calls] : edges) {
+        out << std::setw(10) << calls << "  "
+            << funcs_[key >> 32].name << " -> " << funcs_[key & 0xFFFFFFFFu].name << "\n";
+    }
+
+    // === PER-PC HITS ===
+    // without a symbol table nothing is known about ownership of a pc
+    const char* unowned = vm_.program->functions.empty() ? "?" : "<toplevel>";
+    out << "\n[PC hits]\n"
+        << "    pc        hits  function\n";
+    for (size_t at = 0; at < pc_hits_.size(); ++at) {
+        if (!pc_hits_[at]) continue;
+        const FunctionSymbol* sym = vm_.functionAt(at);
+        out << std::setw(6) << at << std::setw(12) << pc_hits_[at]
+            << "  " << (sym ? sym->name : unowned) << "\n";
+    }
+
+    // === FOLDED STACKS ===
+    out << "\n[Folded stacks]\n";
+    writeFolded(out);
+    out << std::defaultfloat;
+}
+
+void Profiler::writeFolded(std::ostream& out) const {
+    for (size_t n = 0; n < nodes_.size(); ++n) {
+        if (!nodes_[n].self_instrs) continue;
+        out << pathOf(n) << " " << nodes_[n].self_instrs << "\n";
+    }
+}
+
+template void VM::runObserved<Profiler>(Profiler&);
+
+} // namespace detvm
@@ -0,0 +1,52 @@
+#include "runtime.hpp"
+
+namespace detvm {
+
+Runtime::Runtime(std::shared_ptr<const Program> program, size_t reg_count)
+    : vm_(std::move(program), reg_count) {
+    if (!vm_.program || vm_.program->functions.empty())
+        throw std::runtime_error("program has no function symbols (was it linked with --strip?)");
+
+    const auto& functions = vm_.program->functions;
+    by_name_.reserve(functions.size());
+    for (size_t i = 0; i < functions.size(); ++i)
+        by_name_.emplace(functions[i].name, i);
+}
+
+Runtime::Runtime(const std::vector<uint8_t>& image, size_t reg_count)
+    : Runtime(Program::load(image, true), reg_count) {}
+
+Runtime::Runtime(const std::string& path, size_t reg_count)
+    : Runtime(Program::map(path, true), reg_count) {}
+
+const FunctionSymbol* Runtime::find(const std::string& name) const {
+    auto it = by_name_.find(name);
+    return it == by_name_.end() ? nullptr : &vm_.program->functions[it->second];
+}
+
+const FunctionSymbol& Runtime::function(const std::string& name) const {
+    const FunctionSymbol* fn = find(name);
+    if (!fn) throw std::runtime_error("no function named " + name);
+    return *fn;
+}
+
+Value Runtime::call(const FunctionSymbol& fn, std::initializer_list<Value> args) {
+    if (!vm_.natives) vm_.natives = std::make_shared<const std::vector<Native>>(natives_.bind(*vm_.program));
+    return vm_.call(fn, args.begin(), args.size());
+}
+
+Value Runtime::call(const FunctionSymbol& fn, const std::vector<Value>& args) {
+    if (!vm_.natives) vm_.natives = std::make_shared<const std::vector<Native>>(natives_.bind(*vm_.program));
+    return vm_.call(fn, args.data(), args.size());
+}
+
+void Runtime::addNative(const std::string& name, NativeFn fn, uint16_t params) {
+    natives_.add(name, fn, params);
+    vm_.natives.reset(); // rebound on the next call
+}
+
+Value Runtime::call(const std::string& name, std::initializer_list<Value> args) {
+    return call(function(name), args);
+}
+
+} // namespace detvm
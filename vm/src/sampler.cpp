@@ -0,0 +1,181 @@
+#include "sampler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <iomanip>
+#include <map>
+#include <set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/time.h>
+#define DETVM_HAVE_SIGPROF 1
+#endif
+
+namespace detvm {
+
+static std::atomic<Sampler*> g_active{nullptr};
+
+Sampler::Sampler(const VM& vm, size_t slots) : vm_(vm), slots_(slots) {}
+
+Sampler::~Sampler() { stop(); }
+
+bool Sampler::start(unsigned hz) {
+#ifdef DETVM_HAVE_SIGPROF
+    if (running_ || hz == 0) return false;
+
+    Sampler* expected = nullptr;
+    if (!g_active.compare_exchange_strong(expected, this)) return false; // one sampler per process
+
+    struct sigaction sa{};
+    sa.sa_handler = &Sampler::onSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, nullptr) != 0) {
+        g_active = nullptr;
+        return false;
+    }
+
+    itimerval timer{};
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = static_cast<suseconds_t>(std::max(1u, 1000000u / hz));
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        signal(SIGPROF, SIG_DFL);
+        g_active = nullptr;
+        return false;
+    }
+
+    hz_ = hz;
+    running_ = true;
+    return true;
+#else
+    (void)hz;
+    return false;
+#endif
+}
+
+void Sampler::stop() {
+#ifdef DETVM_HAVE_SIGPROF
+    if (!running_) return;
+    itimerval off{};
+    setitimer(ITIMER_PROF, &off, nullptr);
+    signal(SIGPROF, SIG_IGN);
+    g_active = nullptr;
+    running_ = false;
+#endif
+}
+
+void Sampler::onSignal(int) {
+    int saved_errno = errno;
+    if (Sampler* s = g_active.load(std::memory_order_relaxed)) s->record();
+    errno = saved_errno;
+}
+
+// Runs inside the signal handler: no allocation, no locks, no iostreams.
+void Sampler::record() {
+    if (vm_.frames_busy) {
+        dropped_ = dropped_ + 1;
+        return;
+    }
+
+    uint32_t pcs[MAX_DEPTH];
+    uint32_t depth = 0;
+    pcs[depth++] = static_cast<uint32_t>(vm_.pc);
+
+    // each frame remembers where its caller resumes; the call site is one before
+    const std::vector<Frame>& frames = vm_.callstack.frames();
+    for (size_t i = frames.size(); i > 0 && depth < MAX_DEPTH; --i)
+        pcs[depth++] = static_cast<uint32_t>(frames[i - 1].return_pc - 1);
+
+    uint64_t hash = 1469598103934665603ull; // FNV-1a
+    for (uint32_t i = 0; i < depth; ++i) {
+        hash ^= pcs[i];
+        hash *= 1099511628211ull;
+    }
+
+    const size_t n = slots_.size();
+    for (size_t probe = 0; probe < n; ++probe) {
+        Slot& slot = slots_[(hash + probe) % n];
+        if (slot.count == 0) {
+            slot.hash = hash;
+            slot.depth = depth;
+            std::copy(pcs, pcs + depth, slot.pcs);
+            slot.count = 1;
+            taken_ = taken_ + 1;
+            return;
+        }
+        if (slot.hash == hash && slot.depth == depth && std::equal(pcs, pcs + depth, slot.pcs)) {
+            ++slot.count;
+            taken_ = taken_ + 1;
+            return;
+        }
+    }
+    dropped_ = dropped_ + 1;
+}
+
+std::vector<std::string> Sampler::namesOf(const Slot& s) const {
+    std::vector<std::string> names;
+    for (uint32_t i = s.depth; i > 0; --i) {
+        uint32_t at = s.pcs[i - 1];
+        const FunctionSymbol* sym = vm_.functionAt(at);
+        if (sym) names.push_back(sym->name);
+        else if (vm_.program->functions.empty()) names.push_back("pc@" + std::to_string(at));
+        else names.push_back("<toplevel>");
+    }
+    return names;
+}
+
+void Sampler::report(std::ostream& out) const {
+    std::map<std::string, uint64_t> flat, cum;
+    for (const auto& slot : slots_) {
+        if (!slot.count) continue;
+        auto names = namesOf(slot);
+        flat[names.back()] += slot.count;
+        // recursion must not count a sample twice towards the same function
+        std::set<std::string> seen(names.begin(), names.end());
+        for (const auto& n : seen) cum[n] += slot.count;
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> order(flat.begin(), flat.end());
+    for (const auto& [name, c] : cum)
+        if (!flat.count(name)) order.push_back({name, 0});
+    std::sort(order.begin(), order.end(), [&](const auto& a, const auto& b) {
+        if (a.second != b.second) return a.second > b.second;
+        return cum.at(a.first) > cum.at(b.first);
+    });
+
+    const double total = taken_ ? static_cast<double>(taken_) : 1.0;
+    double sum = 0;
+
+    out << "=== detvm samples ===\n"
+        << "Showing " << taken_ << " samples at " << hz_ << " Hz"
+        << " (" << dropped_ << " dropped)\n"
+        << "      flat   flat%    sum%        cum    cum%\n"
+        << std::fixed << std::setprecision(2);
+    for (const auto& [name, f] : order) {
+        sum += f;
+        uint64_t c = cum.at(name);
+        out << std::setw(10) << f << std::setw(7) << 100.0 * f / total << "%"
+            << std::setw(7) << 100.0 * sum / total << "%"
+            << std::setw(11) << c << std::setw(7) << 100.0 * c / total << "%"
+            << "  " << name << "\n";
+    }
+    out << std::defaultfloat;
+}
+
+void Sampler::writeFolded(std::ostream& out) const {
+    // different pcs inside the same functions fold into one line
+    std::map<std::string, uint64_t> folded;
+    for (const auto& slot : slots_) {
+        if (!slot.count) continue;
+        std::string path;
+        for (const auto& n : namesOf(slot)) {
+            if (!path.empty()) path += ';';
+            path += n;
+        }
+        folded[path] += slot.count;
+    }
+    for (const auto& [path, count] : folded) out << path << " " << count << "\n";
+}
+
+} // namespace detvm
@@ -0,0 +1,160 @@
+#include "scheduler.hpp"
+#include "io_service.hpp"
+#include <utility>
+
+namespace detvm {
+
+Scheduler::Scheduler(size_t threads, uint64_t slice) : pool_(threads), slice_(slice ? slice : 1) {}
+
+size_t Scheduler::spawn(std::unique_ptr<VM> vm) {
+    VM* raw = vm.get();
+    raw->scheduler = this;
+    raw->needs_scheduler = false;
+    if (!raw->channels) raw->channels = channels_;
+    if (!raw->shared) raw->shared = shared_;
+    size_t id;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        id = vms_.size();
+        vms_.emplace_back();
+        vms_.back().vm = std::move(vm);
+        ++live_;
+    }
+    schedule(id, raw, true);
+    return id;
+}
+
+void Scheduler::schedule(size_t id, VM* vm, bool first) {
+    auto slice = [this, id, vm] {
+        slices_.fetch_add(1, std::memory_order_relaxed);
+        const RunStatus status = vm->resume(slice_);
+        if (status == RunStatus::Finished) finish(id, vm);
+        else if (status == RunStatus::Pending) awaitIo(id, vm);
+        else if (vm->joining >= 0) park(id, vm);
+        else if (vm->channel_wait >= 0) parkOnChannel(id, vm, static_cast<uint64_t>(std::exchange(vm->channel_wait, -1)));
+        else schedule(id, vm, false);
+    };
+    // a fiber spawned from a worker lands on that worker's own deque, where
+    // it runs next unless an idle worker steals it first
+    if (first) pool_.submit(std::move(slice));
+    else pool_.requeue(std::move(slice));
+}
+
+void Scheduler::finish(size_t id, VM* vm) {
+    std::vector<size_t> wake;
+    std::vector<VM*> vms;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        Entry& e = vms_[id];
+        e.done = true;
+        e.result = vm->regs[RETURN_REG];
+        wake.swap(e.waiters);
+        --live_;
+        parked_ -= wake.size();
+        for (size_t w : wake) vms.push_back(vms_[w].vm.get());
+        // it may have been the last VM that could move a channel for the rest
+        if (live_ > 0) checkDeadlock();
+    }
+    for (size_t k = 0; k < wake.size(); ++k) schedule(wake[k], vms[k], false);
+}
+
+void Scheduler::park(size_t id, VM* vm) {
+    const size_t target = static_cast<size_t>(vm->joining);
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (target == id) throw std::runtime_error("JOIN: fiber " + std::to_string(id) + " joins itself");
+        if (!vms_[target].done) {
+            vms_[target].waiters.push_back(id);
+            ++parked_;
+            checkDeadlock();
+            return;
+        }
+    }
+    schedule(id, vm, false); // finished in the meantime; the JOIN now succeeds
+}
+
+void Scheduler::parkOnChannel(size_t id, VM* vm, uint64_t seen) {
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        channel_sleepers_.fetch_add(1);
+        if (channel_moves_.load() == seen) {
+            channel_parked_.push_back(id);
+            ++parked_;
+            checkDeadlock();
+            return;
+        }
+        channel_sleepers_.fetch_sub(1);
+    }
+    schedule(id, vm, false); // a channel moved since it tried: try again
+}
+
+// Every VM parked on a channel tries again, whichever channel moved; those
+// still blocked come straight back.
+void Scheduler::wakeChannelWaiters() {
+    std::vector<size_t> wake;
+    std::vector<VM*> vms;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        wake.swap(channel_parked_);
+        channel_sleepers_.fetch_sub(wake.size());
+        parked_ -= wake.size();
+        for (size_t w : wake) vms.push_back(vms_[w].vm.get());
+    }
+    for (size_t k = 0; k < wake.size(); ++k) schedule(wake[k], vms[k], false);
+}
+
+void Scheduler::checkDeadlock() const {
+    if (parked_ == live_)
+        throw std::runtime_error("deadlock: all " + std::to_string(live_) +
+                                 " live fibers are waiting in JOIN or on a channel");
+}
+
+void Scheduler::awaitIo(size_t id, VM* vm) {
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        ++io_waiting_;
+    }
+    vm->io->whenDone(vm->io_ticket, [this, id, vm] {
+        schedule(id, vm, false); // before the count drops, so wait() sees it
+        // notify under the lock: once wait() sees the count it may return
+        // and the Scheduler go away
+        std::lock_guard<std::mutex> lock(m_);
+        --io_waiting_;
+        ++io_woken_;
+        io_done_.notify_all();
+    });
+}
+
+bool Scheduler::result(int32_t id, Value& out) {
+    std::lock_guard<std::mutex> lock(m_);
+    if (id < 0 || static_cast<size_t>(id) >= vms_.size())
+        throw std::runtime_error("JOIN: no fiber " + std::to_string(id));
+    const Entry& e = vms_[static_cast<size_t>(id)];
+    if (!e.done) return false;
+    out = e.result;
+    return true;
+}
+
+// The pool going idle is not the end while VMs wait on I/O outside it:
+// sleep until one comes back, then wait for the pool again.
+void Scheduler::wait() {
+    for (;;) {
+        uint64_t woken;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            woken = io_woken_;
+        }
+        pool_.wait();
+        std::unique_lock<std::mutex> lock(m_);
+        if (io_woken_ != woken) continue; // requeued while we waited
+        if (io_waiting_ == 0) return;
+        io_done_.wait(lock, [&] { return io_woken_ != woken; });
+    }
+}
+
+VM& Scheduler::vm(size_t id) {
+    std::lock_guard<std::mutex> lock(m_);
+    return *vms_.at(id).vm;
+}
+
+} // namespace detvm
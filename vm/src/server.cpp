@@ -0,0 +1,209 @@
+#include "server.hpp"
+#include "jobs.hpp"
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#define DETVM_HAVE_UNIX_SOCKETS 1
+#endif
+
+namespace detvm {
+
+Server::Server(std::shared_ptr<const Program> program, size_t threads) : pool_(threads) {
+    for (size_t w = 0; w < pool_.size(); ++w) runtimes_.push_back(std::make_unique<Runtime>(program));
+}
+
+std::string Server::handle(const std::string& request) {
+    Runtime& rt = *runtimes_[ThreadPool::worker()];
+
+    std::istringstream in(request);
+    std::string name;
+    in >> name;
+    std::string rest;
+    std::getline(in, rest);
+
+    std::ostringstream printed;
+    std::string answer;
+    rt.vm().out = &printed;
+    try {
+        const FunctionSymbol* fn = rt.find(name);
+        if (!fn) throw std::runtime_error("no function named " + name);
+        answer = "ok " + rt.call(*fn, parseArgs(rest)).str() + "\n";
+    } catch (const std::exception& e) {
+        answer = std::string("err ") + e.what() + "\n";
+    }
+
+    std::string framed;
+    std::istringstream lines(printed.str());
+    for (std::string line; std::getline(lines, line);) framed += "out " + line + "\n";
+    return framed + answer;
+}
+
+void Server::serve(std::istream& in, std::ostream& out) {
+    struct Slot {
+        std::string text;
+        bool done = false;
+    };
+
+    std::mutex m;
+    std::condition_variable ready;   // an answer finished, or input ended
+    std::condition_variable drained; // the writer made room
+    std::deque<Slot> window;         // answers not yet written, oldest first
+    bool eof = false;
+
+    std::thread writer([&] {
+        std::unique_lock<std::mutex> lock(m);
+        for (;;) {
+            ready.wait(lock, [&] { return (!window.empty() && window.front().done) || (eof && window.empty()); });
+            if (window.empty()) break;
+
+            // write every answer that is ready, then flush once
+            std::string batch;
+            while (!window.empty() && window.front().done) {
+                batch += window.front().text;
+                window.pop_front();
+            }
+            drained.notify_all();
+            lock.unlock();
+            out << batch;
+            out.flush();
+            lock.lock();
+        }
+    });
+
+    for (std::string line; std::getline(in, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(m);
+            drained.wait(lock, [&] { return window.size() < MAX_IN_FLIGHT; });
+            window.emplace_back();
+            slot = &window.back(); // deque::emplace_back keeps element addresses stable
+        }
+        pool_.submit([this, &m, &ready, slot, line = std::move(line)] {
+            std::string text = handle(line);
+            std::lock_guard<std::mutex> lock(m);
+            slot->text = std::move(text);
+            slot->done = true;
+            ready.notify_one();
+        });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m);
+        eof = true;
+    }
+    ready.notify_one();
+    writer.join();
+}
+
+#ifdef DETVM_HAVE_UNIX_SOCKETS
+
+namespace {
+
+// Minimal streambuf over a connected socket.
+class FdBuf : public std::streambuf {
+public:
+    explicit FdBuf(int fd) : fd_(fd) {
+        setg(in_, in_, in_);
+        setp(out_, out_ + sizeof(out_));
+    }
+    ~FdBuf() override { sync(); }
+
+protected:
+    int underflow() override {
+        ssize_t n;
+        do n = ::read(fd_, in_, sizeof(in_));
+        while (n < 0 && errno == EINTR);
+        if (n <= 0) return traits_type::eof();
+        setg(in_, in_, in_ + n);
+        return traits_type::to_int_type(in_[0]);
+    }
+
+    int overflow(int c) override {
+        if (sync() != 0) return traits_type::eof();
+        if (c != traits_type::eof()) {
+            *pptr() = static_cast<char>(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        const char* p = pbase();
+        while (p < pptr()) {
+            ssize_t n = ::write(fd_, p, static_cast<size_t>(pptr() - p));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            p += n;
+        }
+        setp(out_, out_ + sizeof(out_));
+        return 0;
+    }
+
+private:
+    int fd_;
+    char in_[64 * 1024];
+    char out_[64 * 1024];
+};
+
+} // namespace
+
+void Server::listen(const std::string& socket_path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("socket path too long: " + socket_path);
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    ::unlink(socket_path.c_str()); // a stale socket from an earlier run
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 64) != 0) {
+        std::string err = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("cannot listen on " + socket_path + ": " + err);
+    }
+
+    std::signal(SIGPIPE, SIG_IGN); // a client hanging up must not take the server down
+    std::cerr << "[vm] Serving on " << socket_path << "\n";
+    for (;;) {
+        int client = ::accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            std::string err = std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error("accept: " + err);
+        }
+        std::thread([this, client] {
+            {
+                FdBuf in_buf(client), out_buf(client); // the reader and the writer thread each get their own
+                std::istream in(&in_buf);
+                std::ostream out(&out_buf);
+                serve(in, out);
+            }
+            ::close(client);
+        }).detach();
+    }
+}
+
+#else
+
+void Server::listen(const std::string&) {
+    throw std::runtime_error("Unix domain sockets are not supported on this platform; use --serve -");
+}
+
+#endif
+
+} // namespace detvm
@@ -0,0 +1,19 @@
+#include "shared_array.hpp"
+#include <stdexcept>
+#include <string>
+
+namespace detvm {
+
+SharedArray::SharedArray(size_t size)
+    : data_(std::make_unique<std::atomic<int32_t>[]>(size)), size_(size) {
+    for (size_t i = 0; i < size_; ++i) data_[i].store(0, std::memory_order_relaxed);
+}
+
+std::atomic<int32_t>& SharedArray::at(int32_t index) {
+    if (index < 0 || static_cast<size_t>(index) >= size_)
+        throw std::runtime_error("shared array index " + std::to_string(index) + " out of range (size " +
+                                 std::to_string(size_) + ")");
+    return data_[index];
+}
+
+} // namespace detvm
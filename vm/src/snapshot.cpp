@@ -0,0 +1,195 @@
+#include "snapshot.hpp"
+#include "mapped_file.hpp"
+#include <fstream>
+
+namespace detvm {
+
+static constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+static_assert(sizeof(Instruction) == 8, "snapshot TEXT stores raw 8-byte instructions");
+
+// === writing ===
+
+namespace {
+
+struct Out {
+    std::vector<uint8_t> buf;
+
+    template <typename T>
+    void put(T v) {
+        const auto* p = reinterpret_cast<const uint8_t*>(&v);
+        buf.insert(buf.end(), p, p + sizeof(T));
+    }
+    void str(const std::string& s) {
+        put<uint32_t>(static_cast<uint32_t>(s.size()));
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+    void tag(const char* t) { buf.insert(buf.end(), t, t + 4); }
+
+    void value(const Value& v) {
+        if (v.isMapped()) { // saved as the plain array it reads as
+            put<uint8_t>(4);
+            put<int32_t>(v.refcount);
+            values(v.mapped().materialize());
+            return;
+        }
+        put<uint8_t>(static_cast<uint8_t>(v.data.index()));
+        put<int32_t>(v.refcount);
+        std::visit([&](const auto& x) {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<T, int32_t>) put<int32_t>(x);
+            else if constexpr (std::is_same_v<T, double>) put<double>(x);
+            else if constexpr (std::is_same_v<T, bool>) put<uint8_t>(x ? 1 : 0);
+            else if constexpr (std::is_same_v<T, std::string>) str(x);
+            else if constexpr (std::is_same_v<T, Value::ArrayRef>) values(*x);
+        }, v.data);
+    }
+    void values(const std::vector<Value>& vs) {
+        put<uint32_t>(static_cast<uint32_t>(vs.size()));
+        for (const auto& v : vs) value(v);
+    }
+};
+
+Value readValue(Reader& r) {
+    uint8_t kind = r.read<uint8_t>();
+    Value v;
+    v.refcount = r.read<int32_t>();
+    switch (kind) {
+        case 0: v.data = r.read<int32_t>(); break;
+        case 1: v.data = r.read<double>(); break;
+        case 2: v.data = r.read<uint8_t>() != 0; break;
+        case 3: v.data = r.readString(r.read<uint32_t>()); break;
+        case 4: {
+            std::vector<Value> items(r.read<uint32_t>());
+            for (auto& item : items) item = readValue(r);
+            v.data = std::make_shared<std::vector<Value>>(std::move(items));
+            break;
+        }
+        case 5: v.data = std::monostate{}; break;
+        default: throw std::runtime_error("snapshot: bad value kind " + std::to_string(kind));
+    }
+    return v;
+}
+
+std::vector<Value> readValues(Reader& r) {
+    std::vector<Value> vs(r.read<uint32_t>());
+    for (auto& v : vs) v = readValue(r);
+    return vs;
+}
+
+} // namespace
+
+void writeSnapshot(const VM& vm, const std::string& path) {
+    if (!vm.program) throw std::runtime_error("snapshot: no program loaded");
+    const Program& prog = *vm.program;
+
+    Out o;
+    o.tag("DTSN");
+    o.put<uint32_t>(SNAPSHOT_VERSION);
+    const size_t text_offset_at = o.buf.size();
+    o.put<uint64_t>(0); // patched below
+    o.put<uint64_t>(prog.code.size());
+
+    o.tag("POOL");
+    prog.materializeAll(); // a restored program is not lazy, so it needs every constant
+    o.values(prog.constant_pool);
+
+    o.tag("SYMS");
+    o.put<uint32_t>(static_cast<uint32_t>(prog.functions.size()));
+    for (const auto& fn : prog.functions) {
+        o.str(fn.name);
+        o.put<uint32_t>(fn.pc_start);
+        o.put<uint32_t>(fn.pc_end);
+        o.put<uint16_t>(fn.params);
+        o.put<uint16_t>(fn.locals);
+    }
+    o.put<uint32_t>(static_cast<uint32_t>(prog.labels.size()));
+    for (const auto& l : prog.labels) {
+        o.str(l.name);
+        o.put<uint32_t>(l.pc);
+    }
+    o.put<uint32_t>(static_cast<uint32_t>(prog.natives.size()));
+    for (const auto& n : prog.natives) o.str(n);
+
+    o.tag("STAT");
+    o.put<uint64_t>(vm.checkpointed ? vm.checkpoint_pc : vm.pc);
+    o.values(vm.regs);
+    o.values(vm.params);
+    const auto& frames = vm.callstack.frames();
+    o.put<uint32_t>(static_cast<uint32_t>(frames.size()));
+    for (const auto& f : frames) {
+        o.put<uint64_t>(f.return_pc);
+        o.values(f.locals);
+        o.values(f.args);
+    }
+
+    // === TEXT, aligned so restoreSnapshot() can use it in place ===
+    o.buf.resize((o.buf.size() + 7) & ~size_t(7), 0);
+    const uint64_t text_offset = o.buf.size();
+    std::memcpy(o.buf.data() + text_offset_at, &text_offset, sizeof(text_offset));
+    const auto* text = reinterpret_cast<const uint8_t*>(prog.code.data());
+    o.buf.insert(o.buf.end(), text, text + prog.code.size() * sizeof(Instruction));
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) throw std::runtime_error("Failed to open output file: " + path);
+    out.write(reinterpret_cast<const char*>(o.buf.data()), static_cast<std::streamsize>(o.buf.size()));
+    if (!out) throw std::runtime_error("Failed to write snapshot: " + path);
+}
+
+void restoreSnapshot(VM& vm, const std::string& path) {
+    auto image = std::make_shared<const MappedFile>(path);
+    const MappedFile& file = *image;
+    Reader r(file.data(), file.size());
+
+    r.expect("DTSN", 4);
+    if (r.read<uint32_t>() != SNAPSHOT_VERSION)
+        throw std::runtime_error("Unsupported snapshot version");
+    const uint64_t text_offset = r.read<uint64_t>();
+    const uint64_t text_count = r.read<uint64_t>();
+    if (text_offset > file.size() || text_offset % alignof(Instruction) ||
+        text_count > (file.size() - text_offset) / sizeof(Instruction))
+        throw std::runtime_error("snapshot: TEXT out of bounds");
+
+    auto prog = std::make_shared<Program>();
+
+    r.expect("POOL", 4);
+    prog->constant_pool = readValues(r);
+
+    r.expect("SYMS", 4);
+    prog->functions.resize(r.read<uint32_t>());
+    for (auto& fn : prog->functions) {
+        fn.name = r.readString(r.read<uint32_t>());
+        fn.pc_start = r.read<uint32_t>();
+        fn.pc_end = r.read<uint32_t>();
+        fn.params = r.read<uint16_t>();
+        fn.locals = r.read<uint16_t>();
+    }
+    prog->labels.resize(r.read<uint32_t>());
+    for (auto& l : prog->labels) {
+        l.name = r.readString(r.read<uint32_t>());
+        l.pc = r.read<uint32_t>();
+    }
+    prog->natives.resize(r.read<uint32_t>());
+    for (auto& n : prog->natives) n = r.readString(r.read<uint32_t>());
+
+    r.expect("STAT", 4);
+    vm.pc = r.read<uint64_t>();
+    vm.regs = readValues(r);
+    vm.params = readValues(r);
+    while (!vm.callstack.empty()) vm.callstack.pop();
+    for (uint32_t n = r.read<uint32_t>(); n > 0; --n) {
+        Frame f;
+        f.return_pc = r.read<uint64_t>();
+        f.locals = readValues(r);
+        f.args = readValues(r);
+        vm.callstack.push(std::move(f));
+    }
+
+    // TEXT is aligned in the file, so the program runs it straight from the mapping
+    prog->code.view(reinterpret_cast<const Instruction*>(file.data() + text_offset), text_count);
+    prog->image = std::move(image);
+
+    vm.program = std::move(prog);
+}
+
+} // namespace detvm
@@ -0,0 +1,120 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <csignal>
+#define DETVM_HAVE_SIGPROF 1
+#endif
+
+namespace detvm {
+
+static thread_local const ThreadPool* t_pool = nullptr;
+static thread_local int t_worker = -1;
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < threads; ++i) queues_.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threads; ++i) workers_.emplace_back(&ThreadPool::loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_) w.join();
+}
+
+int ThreadPool::worker() { return t_worker; }
+
+void ThreadPool::submit(std::function<void()> task) { push(std::move(task), false); }
+
+void ThreadPool::requeue(std::function<void()> task) { push(std::move(task), true); }
+
+void ThreadPool::push(std::function<void()> task, bool front) {
+    // a task spawning more work keeps it local; steals spread it out later
+    size_t q = (t_pool == this) ? static_cast<size_t>(t_worker)
+                                : next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    pending_.fetch_add(1);
+    {
+        // owners pop from the back, so the front is the end of the line
+        std::lock_guard<std::mutex> lock(queues_[q]->m);
+        if (front) queues_[q]->tasks.push_front(std::move(task));
+        else queues_[q]->tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(m_); // pairs with the predicate check in loop()
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::pop(size_t self, std::function<void()>& out) {
+    {
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.m);
+        if (!own.tasks.empty()) {
+            out = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues_.size(); ++k) {
+        Queue& victim = *queues_[(self + k) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.m);
+        if (!victim.tasks.empty()) {
+            out = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::loop(size_t self) {
+    t_pool = this;
+    t_worker = static_cast<int>(self);
+#ifdef DETVM_HAVE_SIGPROF
+    // the Sampler reads the VM on the thread running it, never a worker's
+    sigset_t profiling;
+    sigemptyset(&profiling);
+    sigaddset(&profiling, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &profiling, nullptr);
+#endif
+
+    for (;;) {
+        std::function<void()> task;
+        if (pop(self, task)) {
+            queued_.fetch_sub(1);
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_);
+                if (!error_) error_ = std::current_exception();
+            }
+            if (pending_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(m_);
+                idle_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_);
+        wake_.wait(lock, [&] { return stop_ || queued_.load() > 0; });
+        if (stop_ && queued_.load() == 0) return;
+    }
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_);
+    idle_.wait(lock, [&] { return pending_.load() == 0; });
+    if (error_) {
+        auto e = error_;
+        error_ = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+} // namespace detvm
@@ -1,4 +1,7 @@
     #include "detvm.hpp"
+    #include "io_service.hpp"
+    #include <algorithm>
+    #include <thread>
 
     namespace detvm {
 
@@ -6,6 +9,10 @@
         setupDispatchTable();
     }
 
+    VM::VM(std::shared_ptr<const Program> prog, size_t reg_count) : VM(reg_count) {
+        program = std::move(prog);
+    }
+
     void VM::setupOpTable() {
         op_table = {
             // Data & Arithmetic
@@ -133,6 +140,41 @@
         dispatch_table[(uint16_t)Opcode::HALT]    = &VM::op_halt;
         dispatch_table[(uint16_t)Opcode::LOADP]   = &VM::op_load_param;
         dispatch_table[(uint16_t)Opcode::LOADLP]  = &VM::op_load_paraml;
+        dispatch_table[(uint16_t)Opcode::CHECKPOINT] = &VM::op_checkpoint;
+
+        // -----------------------------
+        // Fibers
+        // -----------------------------
+        dispatch_table[(uint16_t)Opcode::SPAWN]   = &VM::op_spawn;
+        dispatch_table[(uint16_t)Opcode::YIELD]   = &VM::op_yield;
+        dispatch_table[(uint16_t)Opcode::JOIN]    = &VM::op_join;
+
+        // -----------------------------
+        // Channels
+        // -----------------------------
+        dispatch_table[(uint16_t)Opcode::CHNEW]   = &VM::op_chnew;
+        dispatch_table[(uint16_t)Opcode::CHSEND]  = &VM::op_chsend;
+        dispatch_table[(uint16_t)Opcode::CHRECV]  = &VM::op_chrecv;
+        dispatch_table[(uint16_t)Opcode::CHTRY]   = &VM::op_chtry;
+
+        // -----------------------------
+        // Shared arrays & atomics
+        // -----------------------------
+        dispatch_table[(uint16_t)Opcode::SHNEW]     = &VM::op_shnew;
+        dispatch_table[(uint16_t)Opcode::ALOAD]     = &VM::op_aload;
+        dispatch_table[(uint16_t)Opcode::ASTORE]    = &VM::op_astore;
+        dispatch_table[(uint16_t)Opcode::AFETCHADD] = &VM::op_afetchadd;
+        dispatch_table[(uint16_t)Opcode::ACAS]      = &VM::op_acas;
+        dispatch_table[(uint16_t)Opcode::FENCE]     = &VM::op_fence;
+        dispatch_table[(uint16_t)Opcode::PARMAP]    = &VM::op_parmap;
+        dispatch_table[(uint16_t)Opcode::PARREDUCE] = &VM::op_parreduce;
+        dispatch_table[(uint16_t)Opcode::CALLN]     = &VM::op_calln;
+
+        // -----------------------------
+        // Asynchronous file I/O
+        // -----------------------------
+        dispatch_table[(uint16_t)Opcode::FREAD]   = &VM::op_fread;
+        dispatch_table[(uint16_t)Opcode::FWRITE]  = &VM::op_fwrite;
 
         // -----------------------------
         // Ownership & Borrowing
@@ -160,14 +202,59 @@
 
     void VM::run() {
         pc = 0;
+        preempted_ = false;
+        resume();
+    }
+
+    void VM::resume() {
+        while (resume(UINT64_MAX) != RunStatus::Finished && waitToResume()) {}
+    }
+
+    RunStatus VM::run(uint64_t budget) {
+        pc = 0;
+        preempted_ = false;
+        return resume(budget);
+    }
+
+    RunStatus VM::resume(uint64_t budget) {
+        if (!program) throw std::runtime_error("no program loaded");
+        if (preempted_) {
+            pc = preempt_pc_;
+            preempted_ = false;
+        }
+        rerun_paid_ = false;
+        budget_ = budget > static_cast<uint64_t>(INT64_MAX) ? INT64_MAX : static_cast<int64_t>(budget);
+        segment_ = pc;
+        loop();
+        if (!preempted_) return RunStatus::Finished;
+        return io_ticket >= 0 ? RunStatus::Pending : RunStatus::Preempted;
+    }
+
+    void VM::loop() {
+        const Code& code = program->code;
         while (pc < code.size()) {
             const auto& inst = code[pc];
             dispatch(inst);
         }
     }
 
+    // For the drivers with nobody to hand Pending or Preempted to: waits for
+    // what the VM stopped for, then sets it up to carry on. That is the I/O
+    // in flight; a channel only another thread's VM can move, or a YIELD,
+    // just gives up the thread for a moment. False when the VM finished or
+    // stopped for its host (CHECKPOINT, SPAWN with spawn_suspends).
+    bool VM::waitToResume() {
+        if (!preempted_ || needs_scheduler) return false;
+        if (io_ticket >= 0) io->wait(io_ticket);
+        else std::this_thread::yield();
+        preempted_ = false;
+        pc = preempt_pc_;
+        segment_ = pc;
+        return true;
+    }
+
     void VM::step() {
-        const auto& inst = code[pc];
+        const auto& inst = program->code[pc];
         std::cout << "opcode: " << std::to_string(static_cast<uint8_t>(inst.opcode) ) 
         << ", a = " << std::to_string(inst.a)
         << ", b = " << std::to_string(inst.b)
@@ -193,4 +280,78 @@
     }
 
 
+    VM VM::fork() const {
+        VM child(program, regs.size());
+        child.regs = regs;
+        child.params = params;
+        child.callstack = callstack;
+        child.pc = pc;
+        child.out = out;
+        child.load_symbols = load_symbols;
+        child.stop_at_checkpoint = stop_at_checkpoint;
+        child.checkpointed = checkpointed;
+        child.checkpoint_pc = checkpoint_pc;
+        child.spawn_suspends = spawn_suspends;
+        child.fuel = fuel;
+        child.channels = channels;
+        child.shared = shared;
+        child.natives = natives;
+        child.io = io;
+        child.preempted_ = preempted_;
+        child.preempt_pc_ = preempt_pc_;
+        return child;
+    }
+
+
+    Value VM::call(const FunctionSymbol& fn, const Value* args, size_t argc) {
+        if (argc != fn.params)
+            throw std::runtime_error("call " + fn.name + ": expected " + std::to_string(fn.params) +
+                                     " argument(s), got " + std::to_string(argc));
+
+        if (!program) throw std::runtime_error("no program loaded");
+        const Code& code = program->code;
+        program->enter(fn.pc_start);
+
+        // a HALT inside the previous call can leave frames behind
+        while (!callstack.empty()) callstack.pop();
+        for (auto& r : regs) r = Value();
+        for (auto& p : params) p = Value();
+
+        Frame f;
+        f.locals.resize(fn.locals);
+        f.args.assign(args, args + argc);
+        f.return_pc = code.size(); // returning from the outermost frame ends the loop
+        callstack.push(std::move(f));
+
+        pc = fn.pc_start;
+        preempted_ = false;
+        rerun_paid_ = false;
+        budget_ = INT64_MAX;
+        segment_ = pc;
+        do {
+            // a metered helper (PARMAP/PARREDUCE) pays from a fuel it never runs out of
+            if (metered_) {
+                runBlocks(*metered_, rerun_paid_);
+                rerun_paid_ = false;
+                continue;
+            }
+            while (pc < code.size()) {
+                const auto& inst = code[pc];
+                dispatch(inst);
+            }
+        } while (waitToResume());
+
+        return std::move(regs[RETURN_REG]);
+    }
+
+
+    const FunctionSymbol* Program::functionAt(size_t at) const {
+        auto it = std::upper_bound(functions.begin(), functions.end(), at,
+            [](size_t p, const FunctionSymbol& f) { return p < f.pc_start; });
+        if (it == functions.begin()) return nullptr;
+        --it;
+        return at < it->pc_end ? &*it : nullptr;
+    }
+
+
 } // namespace detvm